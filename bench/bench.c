@@ -0,0 +1,102 @@
+// Benchmark runner for duplicates
+//
+// Runs a command, discarding its stdout, and prints one JSON line with its
+// wall and CPU time, peak RSS and throughput over the given file and byte
+// counts. If the last line the command writes to stderr is a JSON object (as
+// from duplicates --stats=json) it is embedded as "stats".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define STDERR_BUFFER_SIZE (1 << 16)
+
+static double timevalSeconds(struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+// read everything from fd, keeping the last STDERR_BUFFER_SIZE bytes, and return the last non-empty line if it looks like a JSON object
+static char *lastJsonLine(int fd, char *buf) {
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(fd, buf + len, STDERR_BUFFER_SIZE - 1 - len)) > 0) {
+        len += n;
+        if (len == STDERR_BUFFER_SIZE - 1) {
+            // keep the second half, the line we want is at the end
+            memmove(buf, buf + len / 2, len - len / 2);
+            len -= len / 2;
+        }
+    }
+    while (len > 0 && buf[len - 1] == '\n') {
+        len--;
+    }
+    buf[len] = '\0';
+    char *line = strrchr(buf, '\n');
+    line = line == NULL ? buf : line + 1;
+    return line[0] == '{' && len > 0 && buf[len - 1] == '}' ? line : NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 6 || strcmp(argv[4], "--") != 0) {
+        fprintf(stderr, "Usage: %s <name> <files> <bytes> -- <command> [args...]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    char *name = argv[1];
+    long files = atol(argv[2]);
+    long long bytes = atoll(argv[3]);
+
+    int errPipe[2];
+    if (pipe(errPipe) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull != -1) {
+            dup2(devNull, STDOUT_FILENO);
+            close(devNull);
+        }
+        dup2(errPipe[1], STDERR_FILENO);
+        close(errPipe[0]);
+        close(errPipe[1]);
+        execvp(argv[5], &argv[5]);
+        perror(argv[5]);
+        _exit(127);
+    }
+    close(errPipe[1]);
+    char *errBuf = malloc(STDERR_BUFFER_SIZE);
+    if (errBuf == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char *stats = lastJsonLine(errPipe[0], errBuf);
+    close(errPipe[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        perror("wait4");
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    printf("{\"name\": \"%s\", \"exit\": %d, \"files\": %ld, \"bytes\": %lld, \"wall_s\": %.6f, \"user_s\": %.6f, \"sys_s\": %.6f, "
+           "\"files_per_s\": %.1f, \"mb_per_s\": %.2f, \"peak_rss_kb\": %ld, \"stats\": %s}\n",
+           name, exitCode, files, bytes, wall, timevalSeconds(&usage.ru_utime), timevalSeconds(&usage.ru_stime),
+           wall > 0 ? files / wall : 0, wall > 0 ? bytes / wall / (1 << 20) : 0, usage.ru_maxrss, stats != NULL ? stats : "null");
+    free(errBuf);
+    return exitCode == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,227 @@
+// Synthetic tree generator for benchmarking duplicates
+//
+// Builds a reproducible directory tree: the same options and seed always give
+// the same names, sizes and contents. Prints a one-line JSON summary of what
+// it wrote to stdout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define CHECK_ALLOC(ptr) if (ptr == NULL) { perror(__func__); exit(1); }
+
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+// Generator options (dir, numFiles, minSize, maxSize, dupRatio, linkRatio, depth, fanout, seed)
+typedef struct genOptions {
+    char *dir;
+    long numFiles;
+    long minSize;
+    long maxSize;
+    double dupRatio;    // fraction of files that are copies of an earlier file
+    double linkRatio;   // fraction of files that are hard links to an earlier file
+    int depth;
+    int fanout;
+    uint64_t seed;
+} genOptions;
+
+// Generated file struct, enough to make a copy or a link of it later (path, size, contentSeed)
+typedef struct genFile {
+    char *path;
+    long size;
+    uint64_t contentSeed;
+} genFile;
+
+
+// xorshift64*, small and fast and the same everywhere
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// uniform in [0, 1)
+static double nextUnit(uint64_t *state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// log-uniform between min and max, so small files dominate the count and big ones the bytes, like real trees
+static long nextSize(uint64_t *state, long min, long max) {
+    if (min >= max) {
+        return min;
+    }
+    double lo = log((double)min + 1);
+    double hi = log((double)max + 1);
+    return (long)exp(lo + (hi - lo) * nextUnit(state)) - 1;
+}
+
+static void usage(char *progname) {
+    fprintf(stderr, "Usage: %s [options] <directory>\n", progname);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --files <n>\tNumber of files to create (default 10000)\n");
+    fprintf(stderr, "  -s, --min-size <bytes>\tSmallest file size (default 0)\n");
+    fprintf(stderr, "  -S, --max-size <bytes>\tLargest file size, sizes are log-uniform in between (default 1048576)\n");
+    fprintf(stderr, "  -u, --dup-ratio <r>\tFraction of files that copy an earlier file (default 0.3)\n");
+    fprintf(stderr, "  -l, --link-ratio <r>\tFraction of files that hard link an earlier file (default 0.05)\n");
+    fprintf(stderr, "  -d, --depth <n>\tDirectory depth below the root (default 3)\n");
+    fprintf(stderr, "  -f, --fanout <n>\tSubdirectories per directory (default 8)\n");
+    fprintf(stderr, "  -x, --seed <n>\tRandom seed (default 1)\n");
+    exit(EXIT_FAILURE);
+}
+
+// create every directory of a complete fanout-ary tree of the given depth, returning the leaf paths
+static char **makeDirs(genOptions *opts, int *numLeaves) {
+    int count = 1;
+    char **level = malloc(sizeof(char *));
+    CHECK_ALLOC(level);
+    level[0] = strdup(opts->dir);
+    CHECK_ALLOC(level[0]);
+    for (int d = 0; d < opts->depth; d++) {
+        char **nextLevel = malloc((size_t)count * opts->fanout * sizeof(char *));
+        CHECK_ALLOC(nextLevel);
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; j < opts->fanout; j++) {
+                char *path = malloc(strlen(level[i]) + 16);
+                CHECK_ALLOC(path);
+                sprintf(path, "%s/d%d", level[i], j);
+                if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+                    fprintf(stderr, "Error: Cannot create directory %s: %s\n", path, strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+                nextLevel[i * opts->fanout + j] = path;
+            }
+            free(level[i]);
+        }
+        free(level);
+        level = nextLevel;
+        count *= opts->fanout;
+    }
+    *numLeaves = count;
+    return level;
+}
+
+// write size bytes generated from contentSeed, so a copy can be made without reading the original back
+static void writeContent(char *path, long size, uint64_t contentSeed, unsigned char *buf) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Error: Cannot create file %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    uint64_t state = contentSeed | 1;
+    long written = 0;
+    while (written < size) {
+        long len = size - written < WRITE_BUFFER_SIZE ? size - written : WRITE_BUFFER_SIZE;
+        for (long i = 0; i < len; i += 8) {
+            uint64_t word = nextRandom(&state);
+            memcpy(buf + i, &word, len - i < 8 ? len - i : 8);
+        }
+        if (write(fd, buf, len) != len) {
+            fprintf(stderr, "Error: Cannot write file %s: %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        written += len;
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    genOptions opts = {NULL, 10000, 0, 1 << 20, 0.3, 0.05, 3, 8, 1};
+    struct option longOptions[] = {
+        {"files", required_argument, NULL, 'n'},
+        {"min-size", required_argument, NULL, 's'},
+        {"max-size", required_argument, NULL, 'S'},
+        {"dup-ratio", required_argument, NULL, 'u'},
+        {"link-ratio", required_argument, NULL, 'l'},
+        {"depth", required_argument, NULL, 'd'},
+        {"fanout", required_argument, NULL, 'f'},
+        {"seed", required_argument, NULL, 'x'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:s:S:u:l:d:f:x:", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'n': opts.numFiles = atol(optarg); break;
+            case 's': opts.minSize = atol(optarg); break;
+            case 'S': opts.maxSize = atol(optarg); break;
+            case 'u': opts.dupRatio = atof(optarg); break;
+            case 'l': opts.linkRatio = atof(optarg); break;
+            case 'd': opts.depth = atoi(optarg); break;
+            case 'f': opts.fanout = atoi(optarg); break;
+            case 'x': opts.seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || opts.numFiles < 1 || opts.minSize < 0 || opts.maxSize < opts.minSize || opts.depth < 0 || opts.fanout < 1
+        || opts.dupRatio < 0 || opts.linkRatio < 0 || opts.dupRatio + opts.linkRatio > 1) {
+        usage(argv[0]);
+    }
+    opts.dir = argv[optind];
+    if (mkdir(opts.dir, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Error: Cannot create directory %s: %s\n", opts.dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    int numLeaves;
+    char **leaves = makeDirs(&opts, &numLeaves);
+    genFile *files = calloc(opts.numFiles, sizeof(genFile));
+    CHECK_ALLOC(files);
+    unsigned char *buf = malloc(WRITE_BUFFER_SIZE);
+    CHECK_ALLOC(buf);
+    uint64_t state = opts.seed * 0x9e3779b97f4a7c15ULL + 1;
+    long numDups = 0, numLinks = 0;
+    long long totalBytes = 0, uniqueBytes = 0;
+
+    for (long i = 0; i < opts.numFiles; i++) {
+        char *leaf = leaves[nextRandom(&state) % numLeaves];
+        files[i].path = malloc(strlen(leaf) + 32);
+        CHECK_ALLOC(files[i].path);
+        sprintf(files[i].path, "%s/f%ld", leaf, i);
+        double kind = nextUnit(&state);
+        genFile *original = i > 0 ? &files[nextRandom(&state) % i] : NULL;
+
+        if (original != NULL && kind < opts.linkRatio) {
+            unlink(files[i].path);
+            if (link(original->path, files[i].path) == -1) {
+                fprintf(stderr, "Error: Cannot link %s to %s: %s\n", files[i].path, original->path, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            files[i].size = original->size;
+            files[i].contentSeed = original->contentSeed;
+            numLinks++;
+        } else if (original != NULL && kind < opts.linkRatio + opts.dupRatio) {
+            files[i].size = original->size;
+            files[i].contentSeed = original->contentSeed;
+            writeContent(files[i].path, files[i].size, files[i].contentSeed, buf);
+            numDups++;
+        } else {
+            files[i].size = nextSize(&state, opts.minSize, opts.maxSize);
+            files[i].contentSeed = nextRandom(&state);
+            writeContent(files[i].path, files[i].size, files[i].contentSeed, buf);
+            uniqueBytes += files[i].size;
+        }
+        totalBytes += files[i].size;
+    }
+
+    printf("{\"files\": %ld, \"bytes\": %lld, \"unique_bytes\": %lld, \"duplicates\": %ld, \"hard_links\": %ld, \"directories\": %d, \"seed\": %llu}\n",
+           opts.numFiles, totalBytes, uniqueBytes, numDups, numLinks, numLeaves, (unsigned long long)opts.seed);
+
+    for (long i = 0; i < opts.numFiles; i++) {
+        free(files[i].path);
+    }
+    for (int i = 0; i < numLeaves; i++) {
+        free(leaves[i]);
+    }
+    free(leaves);
+    free(files);
+    free(buf);
+    return 0;
+}
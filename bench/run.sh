@@ -0,0 +1,68 @@
+#!/bin/sh
+# Run the duplicates benchmark: generate (or reuse) a synthetic tree, then time
+# a few configurations of the release binary over it. Each result is one JSON
+# line on stdout, the tree summary comes first.
+#
+# Usage: bench/run.sh <duplicates binary> <gentree> <bench>
+# Settings come from the environment, see the bench target in the Makefile.
+
+set -e
+
+DUPLICATES=$1
+GENTREE=$2
+BENCH=$3
+
+BENCH_DIR=${BENCH_DIR:-/tmp/duplicates-bench}
+BENCH_FILES=${BENCH_FILES:-20000}
+BENCH_MIN_SIZE=${BENCH_MIN_SIZE:-0}
+BENCH_MAX_SIZE=${BENCH_MAX_SIZE:-1048576}
+BENCH_DUP_RATIO=${BENCH_DUP_RATIO:-0.3}
+BENCH_LINK_RATIO=${BENCH_LINK_RATIO:-0.05}
+BENCH_DEPTH=${BENCH_DEPTH:-3}
+BENCH_FANOUT=${BENCH_FANOUT:-8}
+BENCH_SEED=${BENCH_SEED:-1}
+BENCH_JOBS=${BENCH_JOBS:-0}
+BENCH_DROP_CACHES=${BENCH_DROP_CACHES:-0}
+
+GEN_ARGS="-n $BENCH_FILES -s $BENCH_MIN_SIZE -S $BENCH_MAX_SIZE -u $BENCH_DUP_RATIO -l $BENCH_LINK_RATIO -d $BENCH_DEPTH -f $BENCH_FANOUT -x $BENCH_SEED"
+
+# the tree is regenerated only when the generator settings change
+if [ ! -f "$BENCH_DIR.json" ] || [ "$(head -n 1 "$BENCH_DIR.json")" != "$GEN_ARGS" ]; then
+    rm -rf "$BENCH_DIR" "$BENCH_DIR.json"
+    SUMMARY=$("$GENTREE" $GEN_ARGS "$BENCH_DIR")
+    printf '%s\n%s\n' "$GEN_ARGS" "$SUMMARY" > "$BENCH_DIR.json"
+fi
+SUMMARY=$(sed -n 2p "$BENCH_DIR.json")
+echo "$SUMMARY"
+FILES=$(echo "$SUMMARY" | sed 's/.*"files": \([0-9]*\).*/\1/')
+BYTES=$(echo "$SUMMARY" | sed 's/.*"bytes": \([0-9]*\).*/\1/')
+
+# drop the page cache before each run when we may, otherwise runs are warm
+prepare() {
+    if [ "$BENCH_DROP_CACHES" = 1 ] && [ -w /proc/sys/vm/drop_caches ]; then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+}
+
+run() {
+    NAME=$1
+    shift
+    prepare
+    "$BENCH" "$NAME" "$FILES" "$BYTES" -- "$DUPLICATES" --stats=json "$@" "$BENCH_DIR"
+}
+
+# warm up once so the first configuration is not the only one paying for cold metadata
+"$DUPLICATES" -r -q "$BENCH_DIR" > /dev/null
+
+CACHE_FILE="$BENCH_DIR.cache"
+rm -f "$CACHE_FILE" "$CACHE_FILE.lock"
+
+run "single-thread" -r -q -j 1
+run "all-cpus" -r -q -j "$BENCH_JOBS"
+run "mmap" -r -q -j "$BENCH_JOBS" -M mmap
+run "uring" -r -q -j "$BENCH_JOBS" -M uring
+run "hash-all" -r -q -j "$BENCH_JOBS" -d 0000000000000000000000000000000000000000000000000000000000000000
+run "cache-cold" -r -q -j "$BENCH_JOBS" -c "$CACHE_FILE"
+run "cache-warm" -r -q -j "$BENCH_JOBS" -c "$CACHE_FILE"
+rm -f "$CACHE_FILE" "$CACHE_FILE.lock"
@@ -0,0 +1,50 @@
+#include "headers/arena.h"
+
+
+arena *initArena() {
+    arena *a = calloc(1, sizeof(arena));
+    CHECK_ALLOC(a);
+    return a;
+}
+
+void *arenaAlloc(arena *a, size_t size) {
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    if (a->head == NULL || a->head->size - a->head->used < size) {
+        // a request too big for a normal chunk gets a chunk of its own, kept behind the one being filled
+        size_t chunkSize = size > ARENA_CHUNK_SIZE / 4 ? size : ARENA_CHUNK_SIZE;
+        arenaChunk *chunk = malloc(sizeof(arenaChunk) + chunkSize);
+        CHECK_ALLOC(chunk);
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        if (chunkSize == size && a->head != NULL) {
+            chunk->used = size;
+            chunk->next = a->head->next;
+            a->head->next = chunk;
+            return chunk->data;
+        }
+        chunk->next = a->head;
+        a->head = chunk;
+    }
+    void *ptr = a->head->data + a->head->used;
+    a->head->used += size;
+    return ptr;
+}
+
+char *arenaStrdup(arena *a, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = arenaAlloc(a, len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+void freeArena(arena *a) {
+    if (a != NULL) {
+        arenaChunk *chunk = a->head;
+        while (chunk != NULL) {
+            arenaChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(a);
+    }
+}
@@ -0,0 +1,293 @@
+/*
+ *  BLAKE3 (unkeyed, 32-byte output), streaming only. Written from the
+ *  BLAKE3 specification and its reference implementation by Jack O'Connor,
+ *  Jean-Philippe Aumasson, Samuel Neves and Zooko Wilcox-O'Hearn (CC0 /
+ *  Apache 2.0). Whole chunks are hashed straight from the input, eight at a
+ *  time with AVX2, and merged into the tree as they complete.
+ */
+
+#include "headers/blake3.h"
+#include "headers/sha256_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+#define CHUNK_START 1
+#define CHUNK_END 2
+#define PARENT 4
+#define ROOT 8
+
+_Static_assert(sizeof(blake3Hasher) <= DIGEST_CONTEXT_MAX, "blake3Hasher does not fit a digest context");
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// message word order for each of the seven rounds, the permutation applied again and again
+static const uint8_t MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+
+static inline uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t loadLE32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void g(uint32_t *s, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+// compress one block into cv, keeping only the 8-word chaining value (all a 32-byte digest needs, even at the root)
+static void compress(uint32_t cv[8], const unsigned char block[BLAKE3_BLOCK_LEN], uint32_t blockLen, uint64_t counter, uint32_t flags) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = loadLE32(block + 4 * i);
+    }
+    uint32_t s[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        IV[0], IV[1], IV[2], IV[3], (uint32_t)counter, (uint32_t)(counter >> 32), blockLen, flags
+    };
+    for (int r = 0; r < 7; r++) {
+        const uint8_t *sched = MSG_SCHEDULE[r];
+        g(s, 0, 4, 8, 12, m[sched[0]], m[sched[1]]);
+        g(s, 1, 5, 9, 13, m[sched[2]], m[sched[3]]);
+        g(s, 2, 6, 10, 14, m[sched[4]], m[sched[5]]);
+        g(s, 3, 7, 11, 15, m[sched[6]], m[sched[7]]);
+        g(s, 0, 5, 10, 15, m[sched[8]], m[sched[9]]);
+        g(s, 1, 6, 11, 12, m[sched[10]], m[sched[11]]);
+        g(s, 2, 7, 8, 13, m[sched[12]], m[sched[13]]);
+        g(s, 3, 4, 9, 14, m[sched[14]], m[sched[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        cv[i] = s[i] ^ s[i + 8];
+    }
+}
+
+// hash one whole chunk straight from the input
+static void hashChunk(const unsigned char *input, uint64_t counter, uint32_t cv[8]) {
+    memcpy(cv, IV, sizeof(IV));
+    for (int b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+        uint32_t flags = (b == 0 ? CHUNK_START : 0) | (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0);
+        compress(cv, input + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, counter, flags);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+#define G8(a, b, c, d, mx, my)                                  \
+{                                                               \
+    a = _mm256_add_epi32(_mm256_add_epi32(a, b), mx);           \
+    d = ROTR8(_mm256_xor_si256(d, a), 16);                      \
+    c = _mm256_add_epi32(c, d);                                 \
+    b = ROTR8(_mm256_xor_si256(b, c), 12);                      \
+    a = _mm256_add_epi32(_mm256_add_epi32(a, b), my);           \
+    d = ROTR8(_mm256_xor_si256(d, a), 8);                       \
+    c = _mm256_add_epi32(c, d);                                 \
+    b = ROTR8(_mm256_xor_si256(b, c), 7);                       \
+}
+
+// AVX2: lane i of every register belongs to chunk i, so eight consecutive chunks are hashed at once
+__attribute__((target("avx2")))
+static void hashChunksAvx2(const unsigned char *input, uint64_t counter, uint32_t cvs[BLAKE3_CHUNKS_X8][8]) {
+    const __m256i offsets = _mm256_setr_epi32(0, BLAKE3_CHUNK_LEN, 2 * BLAKE3_CHUNK_LEN, 3 * BLAKE3_CHUNK_LEN,
+                                              4 * BLAKE3_CHUNK_LEN, 5 * BLAKE3_CHUNK_LEN, 6 * BLAKE3_CHUNK_LEN, 7 * BLAKE3_CHUNK_LEN);
+    uint32_t counterLow[8], counterHigh[8];
+    for (int l = 0; l < 8; l++) {
+        counterLow[l] = (uint32_t)(counter + l);
+        counterHigh[l] = (uint32_t)((counter + l) >> 32);
+    }
+    __m256i cv[8];
+    for (int i = 0; i < 8; i++) {
+        cv[i] = _mm256_set1_epi32((int)IV[i]);
+    }
+    for (int b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+        __m256i m[16];
+        for (int j = 0; j < 16; j++) {
+            m[j] = _mm256_i32gather_epi32((const int *)(input + b * BLAKE3_BLOCK_LEN + 4 * j), offsets, 1);
+        }
+        uint32_t flags = (b == 0 ? CHUNK_START : 0) | (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? CHUNK_END : 0);
+        __m256i s0 = cv[0], s1 = cv[1], s2 = cv[2], s3 = cv[3], s4 = cv[4], s5 = cv[5], s6 = cv[6], s7 = cv[7];
+        __m256i s8 = _mm256_set1_epi32((int)IV[0]), s9 = _mm256_set1_epi32((int)IV[1]);
+        __m256i s10 = _mm256_set1_epi32((int)IV[2]), s11 = _mm256_set1_epi32((int)IV[3]);
+        __m256i s12 = _mm256_loadu_si256((const __m256i *)counterLow), s13 = _mm256_loadu_si256((const __m256i *)counterHigh);
+        __m256i s14 = _mm256_set1_epi32(BLAKE3_BLOCK_LEN), s15 = _mm256_set1_epi32((int)flags);
+        for (int r = 0; r < 7; r++) {
+            const uint8_t *sched = MSG_SCHEDULE[r];
+            G8(s0, s4, s8, s12, m[sched[0]], m[sched[1]]);
+            G8(s1, s5, s9, s13, m[sched[2]], m[sched[3]]);
+            G8(s2, s6, s10, s14, m[sched[4]], m[sched[5]]);
+            G8(s3, s7, s11, s15, m[sched[6]], m[sched[7]]);
+            G8(s0, s5, s10, s15, m[sched[8]], m[sched[9]]);
+            G8(s1, s6, s11, s12, m[sched[10]], m[sched[11]]);
+            G8(s2, s7, s8, s13, m[sched[12]], m[sched[13]]);
+            G8(s3, s4, s9, s14, m[sched[14]], m[sched[15]]);
+        }
+        cv[0] = _mm256_xor_si256(s0, s8); cv[1] = _mm256_xor_si256(s1, s9);
+        cv[2] = _mm256_xor_si256(s2, s10); cv[3] = _mm256_xor_si256(s3, s11);
+        cv[4] = _mm256_xor_si256(s4, s12); cv[5] = _mm256_xor_si256(s5, s13);
+        cv[6] = _mm256_xor_si256(s6, s14); cv[7] = _mm256_xor_si256(s7, s15);
+    }
+    for (int i = 0; i < 8; i++) {
+        uint32_t lane[8];
+        _mm256_storeu_si256((__m256i *)lane, cv[i]);
+        for (int l = 0; l < 8; l++) {
+            cvs[l][i] = lane[l];
+        }
+    }
+}
+
+#endif
+
+static bool useAvx2 = false;
+
+void selectBlake3Kernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    useAvx2 = cpuHasAvx2();
+#endif
+}
+
+// merge a finished chunk into the tree: each trailing zero bit of the chunk count closes a subtree
+static void pushChunkCv(blake3Hasher *hasher, uint32_t cv[8], uint64_t totalChunks) {
+    while ((totalChunks & 1) == 0) {
+        unsigned char block[BLAKE3_BLOCK_LEN];
+        hasher->cvStackLen--;
+        for (int i = 0; i < 8; i++) {
+            for (int k = 0; k < 4; k++) {
+                block[4 * i + k] = (unsigned char)(hasher->cvStack[hasher->cvStackLen][i] >> (8 * k));
+                block[32 + 4 * i + k] = (unsigned char)(cv[i] >> (8 * k));
+            }
+        }
+        memcpy(cv, IV, sizeof(IV));
+        compress(cv, block, BLAKE3_BLOCK_LEN, 0, PARENT);
+        totalChunks >>= 1;
+    }
+    memcpy(hasher->cvStack[hasher->cvStackLen++], cv, 8 * sizeof(uint32_t));
+}
+
+static void resetChunk(blake3Hasher *hasher) {
+    memcpy(hasher->cv, IV, sizeof(IV));
+    hasher->blockLen = 0;
+    hasher->blocksCompressed = 0;
+}
+
+void blake3Init(blake3Hasher *hasher) {
+    resetChunk(hasher);
+    hasher->chunkCounter = 0;
+    hasher->cvStackLen = 0;
+}
+
+void blake3Update(blake3Hasher *hasher, const unsigned char *input, size_t len) {
+    while (len > 0) {
+        // a full chunk is only closed once more input shows it is not the last (and so not the root)
+        if (hasher->blocksCompressed * BLAKE3_BLOCK_LEN + hasher->blockLen == BLAKE3_CHUNK_LEN) {
+            compress(hasher->cv, hasher->block, BLAKE3_BLOCK_LEN, hasher->chunkCounter, CHUNK_END | (hasher->blocksCompressed == 0 ? CHUNK_START : 0));
+            pushChunkCv(hasher, hasher->cv, ++hasher->chunkCounter);
+            resetChunk(hasher);
+        }
+        // whole chunks with more input after them skip the block buffer
+        if (hasher->blocksCompressed == 0 && hasher->blockLen == 0 && len > BLAKE3_CHUNK_LEN) {
+            size_t chunks = (len - 1) / BLAKE3_CHUNK_LEN;
+#if defined(__x86_64__) || defined(__i386__)
+            for (; useAvx2 && chunks >= BLAKE3_CHUNKS_X8; chunks -= BLAKE3_CHUNKS_X8) {
+                uint32_t cvs[BLAKE3_CHUNKS_X8][8];
+                hashChunksAvx2(input, hasher->chunkCounter, cvs);
+                for (int l = 0; l < BLAKE3_CHUNKS_X8; l++) {
+                    pushChunkCv(hasher, cvs[l], ++hasher->chunkCounter);
+                }
+                input += BLAKE3_CHUNKS_X8 * BLAKE3_CHUNK_LEN;
+                len -= BLAKE3_CHUNKS_X8 * BLAKE3_CHUNK_LEN;
+            }
+#endif
+            for (; chunks > 0; chunks--) {
+                uint32_t cv[8];
+                hashChunk(input, hasher->chunkCounter, cv);
+                pushChunkCv(hasher, cv, ++hasher->chunkCounter);
+                input += BLAKE3_CHUNK_LEN;
+                len -= BLAKE3_CHUNK_LEN;
+            }
+        }
+        // otherwise fill the chunk a block at a time, holding back the last block for the end flag
+        size_t take = BLAKE3_CHUNK_LEN - hasher->blocksCompressed * BLAKE3_BLOCK_LEN - hasher->blockLen;
+        take = take < len ? take : len;
+        len -= take;
+        while (take > 0) {
+            if (hasher->blockLen == BLAKE3_BLOCK_LEN) {
+                compress(hasher->cv, hasher->block, BLAKE3_BLOCK_LEN, hasher->chunkCounter, hasher->blocksCompressed == 0 ? CHUNK_START : 0);
+                hasher->blocksCompressed++;
+                hasher->blockLen = 0;
+            }
+            size_t n = BLAKE3_BLOCK_LEN - hasher->blockLen;
+            n = n < take ? n : take;
+            memcpy(hasher->block + hasher->blockLen, input, n);
+            hasher->blockLen += n;
+            input += n;
+            take -= n;
+        }
+    }
+}
+
+void blake3Final(blake3Hasher *hasher, sha2Digest *digest) {
+    unsigned char block[BLAKE3_BLOCK_LEN];
+    uint32_t cv[8];
+    memset(block, 0, sizeof(block));
+    memcpy(block, hasher->block, hasher->blockLen);
+    memcpy(cv, hasher->cv, sizeof(cv));
+    uint32_t flags = CHUNK_END | (hasher->blocksCompressed == 0 ? CHUNK_START : 0);
+    // the last chunk is the root only if it is the only chunk, otherwise the parents up the stack are
+    if (hasher->cvStackLen == 0) {
+        compress(cv, block, (uint32_t)hasher->blockLen, hasher->chunkCounter, flags | ROOT);
+    } else {
+        compress(cv, block, (uint32_t)hasher->blockLen, hasher->chunkCounter, flags);
+        for (int n = hasher->cvStackLen - 1; n >= 0; n--) {
+            for (int i = 0; i < 8; i++) {
+                for (int k = 0; k < 4; k++) {
+                    block[4 * i + k] = (unsigned char)(hasher->cvStack[n][i] >> (8 * k));
+                    block[32 + 4 * i + k] = (unsigned char)(cv[i] >> (8 * k));
+                }
+            }
+            memcpy(cv, IV, sizeof(IV));
+            compress(cv, block, BLAKE3_BLOCK_LEN, 0, PARENT | (n == 0 ? ROOT : 0));
+        }
+    }
+    unsigned char *bytes = (unsigned char *)digest->words;
+    for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < 4; k++) {
+            bytes[4 * i + k] = (unsigned char)(cv[i] >> (8 * k));
+        }
+    }
+}
+
+static void blake3OpsInit(void *ctx) {
+    blake3Init(ctx);
+}
+
+static void blake3OpsUpdate(void *ctx, const unsigned char *buf, size_t len) {
+    blake3Update(ctx, buf, len);
+}
+
+static void blake3OpsFinish(void *ctx, sha2Digest *digest) {
+    blake3Final(ctx, digest);
+}
+
+const digestOps blake3Ops = {"blake3", 32, sizeof(blake3Hasher), blake3OpsInit, blake3OpsUpdate, blake3OpsFinish};
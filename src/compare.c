@@ -0,0 +1,97 @@
+#include "headers/compare.h"
+
+
+// One round of compareFiles, the chunk just read from every file still being read (numFiles, reading, classOf, chunks, lens, split)
+typedef struct compareRound {
+    int numFiles;
+    bool *reading;
+    int *classOf;
+    unsigned char **chunks;
+    ssize_t *lens;
+    int *split;
+} compareRound;
+
+// split each class by this chunk, a file joins the first earlier file of its old class with the same bytes
+static void splitClasses(void *arg) {
+    compareRound *round = arg;
+    for (int i = 0; i < round->numFiles; i++) {
+        if (!round->reading[i]) {
+            continue;
+        }
+        round->split[i] = i;
+        for (int j = 0; j < i; j++) {
+            if (round->reading[j] && round->split[j] == j && round->classOf[j] == round->classOf[i]
+                && round->lens[j] == round->lens[i] && memcmp(round->chunks[j], round->chunks[i], round->lens[i]) == 0) {
+                round->split[i] = j;
+                break;
+            }
+        }
+    }
+}
+
+void compareFiles(char **paths, int numFiles, readConfig *config, int *classOf) {
+    readStream streams[COMPARE_MAX_FILES];
+    bool reading[COMPARE_MAX_FILES];
+    unsigned char *chunks[COMPARE_MAX_FILES];
+    ssize_t lens[COMPARE_MAX_FILES];
+    int numReading = 0;
+
+    // every file that opens starts in one class, led by the first of them
+    int first = -1;
+    for (int i = 0; i < numFiles; i++) {
+        reading[i] = openReadStream(&streams[i], paths[i], config);
+        if (!reading[i]) {
+            classOf[i] = -1;
+            continue;
+        }
+        first = first == -1 ? i : first;
+        classOf[i] = first;
+        numReading++;
+    }
+
+    while (numReading > 0) {
+        for (int i = 0; i < numFiles; i++) {
+            if (!reading[i]) {
+                continue;
+            }
+            lens[i] = nextReadChunk(&streams[i], &chunks[i]);
+            if (lens[i] < 0) {
+                closeReadStream(&streams[i]);
+                reading[i] = false;
+                classOf[i] = -1;
+                numReading--;
+            }
+        }
+
+        // a mapped file truncated since it was opened is dropped as unreadable and the round run again without it
+        int split[COMPARE_MAX_FILES];
+        compareRound round = {numFiles, reading, classOf, chunks, lens, split};
+        void *fault;
+        while (!guardMappedAccess(splitClasses, &round, &fault)) {
+            for (int i = 0; i < numFiles; i++) {
+                if (reading[i] && streamMapHolds(&streams[i], fault)) {
+                    closeReadStream(&streams[i]);
+                    reading[i] = false;
+                    classOf[i] = -1;
+                    numReading--;
+                }
+            }
+        }
+        int members[COMPARE_MAX_FILES] = {0};
+        for (int i = 0; i < numFiles; i++) {
+            if (reading[i]) {
+                classOf[i] = split[i];
+                members[split[i]]++;
+            }
+        }
+
+        // a file that matches nobody is unique and needs no more reads, a class at end of file is confirmed
+        for (int i = 0; i < numFiles; i++) {
+            if (reading[i] && (members[classOf[i]] == 1 || lens[i] == 0)) {
+                closeReadStream(&streams[i]);
+                reading[i] = false;
+                numReading--;
+            }
+        }
+    }
+}
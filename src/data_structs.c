@@ -1,89 +1,271 @@
 #include "headers/data_structs.h"
 
 
-fileInfo *initFileInfo(char *filename, char *path, size_t size, ino_t inode) {
-    fileInfo *newFile = calloc(1, sizeof(fileInfo));
+pathNode *initPathNode(arena *a, pathNode *parent, const char *name) {
+    size_t nameLen = strlen(name);
+    pathNode *node = arenaAlloc(a, sizeof(pathNode) + nameLen + 1);
+    node->parent = parent;
+    node->length = parent != NULL ? parent->length + 1 + nameLen : nameLen;
+    memcpy(node->name, name, nameLen + 1);
+    return node;
+}
+
+// write a directory's path so it ends just before end, walking up from the deepest name
+static void writeDirPath(pathNode *node, char *end) {
+    for (; node != NULL; node = node->parent) {
+        size_t nameLen = node->parent != NULL ? node->length - node->parent->length - 1 : node->length;
+        end -= nameLen;
+        memcpy(end, node->name, nameLen);
+        if (node->parent != NULL) {
+            *--end = '/';
+        }
+    }
+}
+
+void buildDirPath(pathNode *node, char *buf) {
+    writeDirPath(node, buf + node->length);
+    buf[node->length] = '\0';
+}
+
+fileInfo *initFileInfo(arena *a, pathNode *dir, const char *name, struct stat *statBuf) {
+    // the name shares the record's allocation, only the directory above it is shared with other files
+    size_t nameLen = strlen(name);
+    fileInfo *newFile = a != NULL ? arenaAlloc(a, sizeof(fileInfo) + nameLen + 1) : malloc(sizeof(fileInfo) + nameLen + 1);
     CHECK_ALLOC(newFile);
-    newFile->filename = strdup(filename);
-    CHECK_ALLOC(newFile->filename);
-    newFile->path = strdup(path);
-    CHECK_ALLOC(newFile->path);
-    newFile->size = size;
-    newFile->inode = inode;
-    newFile->hash = NULL;
-    newFile->next = NULL;
+    memset(newFile, 0, sizeof(fileInfo));
+    newFile->filename = (char *)(newFile + 1);
+    memcpy(newFile->filename, name, nameLen + 1);
+    newFile->dir = dir;
+    newFile->size = statBuf->st_size;
+    newFile->allocated = statBuf->st_blocks * 512;
+    newFile->inode = statBuf->st_ino;
+    newFile->device = statBuf->st_dev;
+    newFile->mtime = statBuf->st_mtim;
+    newFile->ctime = statBuf->st_ctim;
+    newFile->hashed = false;
     return newFile;
 }
 
+size_t filePathLength(fileInfo *file) {
+    return file->dir->length + 1 + strlen(file->filename);
+}
+
+bool buildFilePath(fileInfo *file, char *buf, size_t bufSize) {
+    size_t len = filePathLength(file);
+    if (len >= bufSize) {
+        return false;
+    }
+    writeDirPath(file->dir, buf + file->dir->length);
+    buf[file->dir->length] = '/';
+    strcpy(buf + file->dir->length + 1, file->filename);
+    return true;
+}
+
+char *filePath(fileInfo *file) {
+    size_t len = filePathLength(file);
+    char *path = malloc(len + 1);
+    CHECK_ALLOC(path);
+    buildFilePath(file, path, len + 1);
+    return path;
+}
+
 void printFileInfo(fileInfo *file) {
+    char *path = filePath(file);
     printf("Filename: %s\n", file->filename);
-    printf("Path: %s\n", file->path);
+    printf("Path: %s\n", path);
+    free(path);
     printf("Size: %zu\n", file->size);
     printf("Inode: %lu\n", file->inode);
-    printf("Hash: %s\n", file->hash);
-    if (file->next != NULL) {
-        printf("Next: %s\n", file->next->filename);
-    } else {
-        printf("Next: NULL\n");
+    char hex[SHA2_DIGEST_LEN_STR + 1];
+    digestToHex(&file->hash, hex);
+    printf("Hash: %s\n", file->hashed ? hex : "(none)");
+}
+
+inodeMap *initInodeMap() {
+    inodeMap *im = calloc(1, sizeof(inodeMap));
+    CHECK_ALLOC(im);
+    im->numSlots = INODE_MAP_MIN_SLOTS;
+    im->slots = calloc(im->numSlots, sizeof(inodeSlot));
+    CHECK_ALLOC(im->slots);
+    return im;
+}
+
+// Probe for a device and inode: either the slot holding them or the empty slot they would go in
+static inodeSlot *probeInodeMap(inodeMap *im, dev_t device, ino_t inode) {
+    // inode numbers are often sequential, so mix them before masking
+    uint64_t key = ((uint64_t)inode ^ ((uint64_t)device << 32 | (uint64_t)device >> 32)) * 0x9e3779b97f4a7c15ULL;
+    unsigned long mask = im->numSlots - 1;
+    unsigned long index = (key >> 32) & mask;
+    while (im->slots[index].file != NULL && (im->slots[index].inode != inode || im->slots[index].device != device)) {
+        index = (index + 1) & mask;
     }
+    return &im->slots[index];
 }
 
-void freeFileInfo(fileInfo *file) {
-    if (file != NULL) {
-        free(file->filename);
-        free(file->path);
-        free(file->hash);
-        free(file);
+void addFileInodeMap(inodeMap *im, fileInfo *file) {
+    inodeSlot *slot = probeInodeMap(im, file->device, file->inode);
+    if (slot->file != NULL) {
+        file->primary = slot->file;
+        return;
+    }
+    *slot = (inodeSlot){file->device, file->inode, file};
+    im->numInodes++;
+    // double at 70% full to keep probe sequences short
+    if ((long)im->numInodes * 10 > (long)im->numSlots * 7) {
+        inodeSlot *oldSlots = im->slots;
+        int oldNumSlots = im->numSlots;
+        im->numSlots *= 2;
+        im->slots = calloc(im->numSlots, sizeof(inodeSlot));
+        CHECK_ALLOC(im->slots);
+        for (int i = 0; i < oldNumSlots; i++) {
+            if (oldSlots[i].file != NULL) {
+                *probeInodeMap(im, oldSlots[i].device, oldSlots[i].inode) = oldSlots[i];
+            }
+        }
+        free(oldSlots);
     }
 }
 
-bucket *initBucket() {
-    bucket *newBucket = calloc(1, sizeof(bucket));
-    CHECK_ALLOC(newBucket);
-    return newBucket;
+// Delete a slot, moving later slots of its probe sequence back so none of them is cut off from its first slot
+static void deleteInodeSlot(inodeMap *im, inodeSlot *slot) {
+    unsigned long mask = im->numSlots - 1;
+    unsigned long hole = slot - im->slots;
+    im->slots[hole].file = NULL;
+    im->numInodes--;
+    for (unsigned long index = (hole + 1) & mask; im->slots[index].file != NULL; index = (index + 1) & mask) {
+        inodeSlot moved = im->slots[index];
+        im->slots[index].file = NULL;
+        *probeInodeMap(im, moved.device, moved.inode) = moved;
+    }
 }
 
-hashTable *initHashTable(int size) {
-    hashTable *newHashTable = calloc(1, sizeof(hashTable));
-    CHECK_ALLOC(newHashTable);
-    newHashTable->size = size;
-    newHashTable->buckets = calloc(size, sizeof(bucket *));
-    CHECK_ALLOC(newHashTable->buckets);
-    for (int i = 0; i < size; i++) {
-        newHashTable->buckets[i] = initBucket();
+void freeInodeMap(inodeMap *im) {
+    if (im != NULL) {
+        free(im->slots);
+        free(im);
     }
-    return newHashTable;
 }
 
-void printHashTable(hashTable *ht) {
-    printf("HASH TABLE:\n\n");
-    for (int i = 0; i < ht->size; i++) {
-        printf("Bucket %d (%d):\n", i, ht->buckets[i]->numFiles);
-        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-        fileInfo *current = ht->buckets[i]->head;
-        while (current != NULL) {
-            printFileInfo(current);
-            printf("\n");
-            current = current->next;
+sizeTable *initSizeTable(int size, int numArenas) {
+    sizeTable *newSizeTable = calloc(1, sizeof(sizeTable));
+    CHECK_ALLOC(newSizeTable);
+    newSizeTable->size = size;
+    newSizeTable->buckets = calloc(size, sizeof(sizeGroup *));
+    CHECK_ALLOC(newSizeTable->buckets);
+    newSizeTable->numArenas = numArenas;
+    newSizeTable->arenas = calloc(numArenas, sizeof(arena *));
+    CHECK_ALLOC(newSizeTable->arenas);
+    for (int i = 0; i < numArenas; i++) {
+        newSizeTable->arenas[i] = initArena();
+    }
+    newSizeTable->inodes = initInodeMap();
+    return newSizeTable;
+}
+
+sizeGroup *getSizeGroup(sizeTable *st, size_t size) {
+    sizeGroup *current = st->buckets[size % st->size];
+    while (current != NULL && current->size != size) {
+        current = current->next;
+    }
+    return current;
+}
+
+void addFileSizeTable(sizeTable *st, fileInfo *file) {
+    sizeGroup *group = getSizeGroup(st, file->size);
+    if (group == NULL) {
+        group = calloc(1, sizeof(sizeGroup));
+        CHECK_ALLOC(group);
+        group->size = file->size;
+        group->next = st->buckets[file->size % st->size];
+        st->buckets[file->size % st->size] = group;
+    }
+    // grow by doubling, these arrays reach millions of entries on large trees
+    if (group->numFiles == group->capacity) {
+        group->capacity = group->capacity == 0 ? 2 : group->capacity * 2;
+        group->files = realloc(group->files, group->capacity * sizeof(fileInfo *));
+        CHECK_ALLOC(group->files);
+    }
+    group->files[group->numFiles++] = file;
+
+    if (st->numFiles == st->capacity) {
+        st->capacity = st->capacity == 0 ? 64 : st->capacity * 2;
+        st->files = realloc(st->files, st->capacity * sizeof(fileInfo *));
+        CHECK_ALLOC(st->files);
+    }
+    st->files[st->numFiles++] = file;
+
+    // files arrive in traversal order, so an inode's primary is its first name in the output too
+    addFileInodeMap(st->inodes, file);
+}
+
+void addDirSizeTable(sizeTable *st, pathNode *dir) {
+    if (st->numDirs == st->dirCapacity) {
+        st->dirCapacity = st->dirCapacity == 0 ? 64 : st->dirCapacity * 2;
+        st->dirs = realloc(st->dirs, st->dirCapacity * sizeof(pathNode *));
+        CHECK_ALLOC(st->dirs);
+    }
+    st->dirs[st->numDirs++] = dir;
+}
+
+void removeFileSizeTable(sizeTable *st, fileInfo *file) {
+    sizeGroup *group = getSizeGroup(st, file->size);
+    if (group == NULL) {
+        return;
+    }
+    fileInfo *successor = NULL;
+    for (int i = 0; i < group->numFiles; i++) {
+        if (group->files[i] == file) {
+            memmove(&group->files[i], &group->files[i + 1], (group->numFiles - i - 1) * sizeof(fileInfo *));
+            group->numFiles--;
+            i--;
+            continue;
+        }
+        // every name of an inode has its size, so the other names of a primary are all in this group
+        if (file->primary == NULL && group->files[i]->primary == file) {
+            if (successor == NULL) {
+                successor = group->files[i];
+                successor->primary = NULL;
+            } else {
+                group->files[i]->primary = successor;
+            }
+        }
+    }
+    if (file->primary != NULL) {
+        return;
+    }
+    inodeSlot *slot = probeInodeMap(st->inodes, file->device, file->inode);
+    if (slot->file == file) {
+        if (successor != NULL) {
+            slot->file = successor;
+        } else {
+            // an inode number is soon reused by an unrelated file, which must not be taken for a link
+            deleteInodeSlot(st->inodes, slot);
         }
-        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-        printf("\n");
     }
-    printf("-------------------------------------------------------------------------------------\n");
 }
 
-void freeHashTable(hashTable *ht) {
-    for (int i = 0; i < ht->size; i++) {
-        fileInfo *current = ht->buckets[i]->head;
-        while (current != NULL) {
-            fileInfo *temp = current;
-            current = current->next;
-            freeFileInfo(temp);
+void freeSizeTable(sizeTable *st) {
+    if (st != NULL) {
+        for (int i = 0; i < st->size; i++) {
+            sizeGroup *current = st->buckets[i];
+            while (current != NULL) {
+                sizeGroup *temp = current;
+                current = current->next;
+                free(temp->files);
+                free(temp);
+            }
+        }
+        // every fileInfo and path was bump allocated, so they all go with their arenas
+        for (int i = 0; i < st->numArenas; i++) {
+            freeArena(st->arenas[i]);
         }
-        free(ht->buckets[i]);
+        free(st->arenas);
+        freeInodeMap(st->inodes);
+        free(st->files);
+        free(st->dirs);
+        free(st->buckets);
+        free(st);
     }
-    free(ht->buckets);
-    free(ht);
 }
 
 optionList *initOptionList() {
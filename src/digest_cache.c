@@ -0,0 +1,258 @@
+#include "headers/digest_cache.h"
+
+#include <libgen.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+
+static int64_t timespecNs(struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static int compareCacheKey(const cacheEntry *a, const cacheEntry *b) {
+    if (a->device != b->device) {
+        return a->device < b->device ? -1 : 1;
+    }
+    if (a->inode != b->inode) {
+        return a->inode < b->inode ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compareCacheEntry(const void *a, const void *b) {
+    return compareCacheKey(a, b);
+}
+
+// map a cache file and check its header, entries are used in place without being parsed; algo gets the algorithm it holds
+static bool mapCacheFile(char *path, void **map, size_t *mapSize, cacheEntry **entries, size_t *numEntries, char algo[8]) {
+    *map = NULL;
+    *mapSize = 0;
+    *entries = NULL;
+    *numEntries = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        // no cache yet is not an error, the first run creates it
+        return errno == ENOENT;
+    }
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1 || (statBuf.st_size != 0 && (size_t)statBuf.st_size < sizeof(cacheHeader))) {
+        close(fd);
+        return false;
+    }
+    if (statBuf.st_size == 0) {
+        // an empty file (made with touch, say) is an empty cache, mmap would refuse it
+        close(fd);
+        return true;
+    }
+    void *data = mmap(NULL, statBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    cacheHeader *header = data;
+    if (memcmp(header->magic, DIGEST_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != DIGEST_CACHE_VERSION
+        || header->entrySize != sizeof(cacheEntry)
+        || header->numEntries != ((size_t)statBuf.st_size - sizeof(cacheHeader)) / sizeof(cacheEntry)
+        || ((size_t)statBuf.st_size - sizeof(cacheHeader)) % sizeof(cacheEntry) != 0) {
+        munmap(data, statBuf.st_size);
+        return false;
+    }
+    memcpy(algo, header->algo, sizeof(header->algo));
+    *map = data;
+    *mapSize = statBuf.st_size;
+    *entries = (cacheEntry *)(header + 1);
+    *numEntries = header->numEntries;
+    return true;
+}
+
+digestCache *openDigestCache(char *path, char *algo) {
+    digestCache *dc = calloc(1, sizeof(digestCache));
+    CHECK_ALLOC(dc);
+    dc->path = strdup(path);
+    CHECK_ALLOC(dc->path);
+    memcpy(dc->algo, algo, strnlen(algo, sizeof(dc->algo)));
+    char fileAlgo[8];
+    if (!mapCacheFile(path, &dc->map, &dc->mapSize, &dc->entries, &dc->numEntries, fileAlgo)) {
+        fprintf(stderr, "Warning: Ignoring unreadable digest cache %s\n", path);
+    } else if (dc->map != NULL && memcmp(fileAlgo, dc->algo, sizeof(dc->algo)) != 0) {
+        // its digests cannot be compared with ours, and overwriting it would throw them away
+        fprintf(stderr, "Warning: Not using digest cache %s, it holds %.8s digests\n", path, fileAlgo);
+        freeDigestCache(dc);
+        return NULL;
+    }
+    dc->used = calloc(dc->numEntries + 1, 1);   // +1 so an empty cache still allocates
+    CHECK_ALLOC(dc->used);
+    return dc;
+}
+
+bool lookupDigestCache(digestCache *dc, fileInfo *file, sha2Digest *digest) {
+    cacheEntry key = {.device = file->device, .inode = file->inode};
+    cacheEntry *found = bsearch(&key, dc->entries, dc->numEntries, sizeof(cacheEntry), compareCacheEntry);
+    // any change to the file moves its ctime, so a match on all of these means the contents are the ones hashed
+    if (found == NULL || found->size != file->size || found->mtime != timespecNs(&file->mtime) || found->ctime != timespecNs(&file->ctime)) {
+        return false;
+    }
+    *digest = found->digest;
+    dc->used[found - dc->entries] = 1;
+    return true;
+}
+
+// append an entry to the updates, zeroed
+static cacheEntry *pushCacheUpdate(digestCache *dc) {
+    if (dc->numUpdates == dc->capacity) {
+        dc->capacity = dc->capacity == 0 ? 1024 : dc->capacity * 2;
+        dc->updates = realloc(dc->updates, dc->capacity * sizeof(cacheEntry));
+        CHECK_ALLOC(dc->updates);
+    }
+    cacheEntry *entry = &dc->updates[dc->numUpdates++];
+    memset(entry, 0, sizeof(cacheEntry));
+    return entry;
+}
+
+void addDigestCache(digestCache *dc, fileInfo *file) {
+    cacheEntry *entry = pushCacheUpdate(dc);
+    entry->device = file->device;
+    entry->inode = file->inode;
+    entry->size = file->size;
+    entry->mtime = timespecNs(&file->mtime);
+    entry->ctime = timespecNs(&file->ctime);
+    entry->digest = file->hash;
+}
+
+// write the merge of the on-disk entries and the updates (which win for the same file) to fp, leaving out on-disk entries last seen before expired
+static bool writeMergedEntries(FILE *fp, cacheEntry *current, size_t numCurrent, cacheEntry *updates, size_t numUpdates, int64_t expired, uint64_t *numWritten) {
+    size_t i = 0, j = 0;
+    *numWritten = 0;
+    while (i < numCurrent || j < numUpdates) {
+        cacheEntry *next;
+        if (j == numUpdates) {
+            next = &current[i++];
+        } else if (i == numCurrent) {
+            next = &updates[j++];
+        } else {
+            int cmp = compareCacheKey(&current[i], &updates[j]);
+            if (cmp < 0) {
+                next = &current[i++];
+            } else {
+                next = &updates[j++];
+                i += cmp == 0;
+            }
+        }
+        // a file deleted or moved off its device is never looked up again, so its entry ages out
+        if (next->seen < expired) {
+            continue;
+        }
+        if (fwrite(next, sizeof(cacheEntry), 1, fp) != 1) {
+            return false;
+        }
+        (*numWritten)++;
+    }
+    return true;
+}
+
+bool saveDigestCache(digestCache *dc) {
+    // entries this run used are written back too, so their last seen time moves on
+    int64_t now = time(NULL);
+    for (size_t i = 0; i < dc->numEntries; i++) {
+        if (dc->used[i]) {
+            *pushCacheUpdate(dc) = dc->entries[i];
+        }
+    }
+    for (size_t i = 0; i < dc->numUpdates; i++) {
+        dc->updates[i].seen = now;
+    }
+
+    // sort the updates and keep one per file, hard links show up once per name
+    qsort(dc->updates, dc->numUpdates, sizeof(cacheEntry), compareCacheEntry);
+    size_t numUnique = 0;
+    for (size_t i = 0; i < dc->numUpdates; i++) {
+        if (numUnique > 0 && compareCacheKey(&dc->updates[numUnique - 1], &dc->updates[i]) == 0) {
+            dc->updates[numUnique - 1] = dc->updates[i];
+        } else {
+            dc->updates[numUnique++] = dc->updates[i];
+        }
+    }
+    dc->numUpdates = numUnique;
+
+    // concurrent runs take turns writing, each merging into whatever the last one left
+    size_t pathLen = strlen(dc->path);
+    char *lockPath = malloc(pathLen + sizeof(".lock"));
+    CHECK_ALLOC(lockPath);
+    sprintf(lockPath, "%s.lock", dc->path);
+    int lockFd = open(lockPath, O_RDWR | O_CREAT, 0644);
+    free(lockPath);
+    if (lockFd == -1 || flock(lockFd, LOCK_EX) == -1) {
+        fprintf(stderr, "Warning: Cannot lock digest cache %s: %s\n", dc->path, strerror(errno));
+        if (lockFd != -1) {
+            close(lockFd);
+        }
+        return false;
+    }
+    void *map;
+    size_t mapSize;
+    cacheEntry *current;
+    size_t numCurrent;
+    char fileAlgo[8];
+    if (!mapCacheFile(dc->path, &map, &mapSize, &current, &numCurrent, fileAlgo) || (map != NULL && memcmp(fileAlgo, dc->algo, sizeof(dc->algo)) != 0)) {
+        numCurrent = 0;
+    }
+
+    // write a temporary file next to the cache and rename it over, so a crash leaves the old cache whole
+    char *tmpPath = malloc(pathLen + sizeof(".XXXXXX"));
+    CHECK_ALLOC(tmpPath);
+    sprintf(tmpPath, "%s.XXXXXX", dc->path);
+    int fd = mkstemp(tmpPath);
+    if (fd != -1) {
+        fchmod(fd, 0644);
+    }
+    FILE *fp = fd == -1 ? NULL : fdopen(fd, "w");
+    bool ok = fp != NULL;
+    cacheHeader header = {.version = DIGEST_CACHE_VERSION, .entrySize = sizeof(cacheEntry)};
+    memcpy(header.magic, DIGEST_CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.algo, dc->algo, sizeof(header.algo));
+    ok = ok && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && writeMergedEntries(fp, current, numCurrent, dc->updates, dc->numUpdates, now - (int64_t)DIGEST_CACHE_EXPIRY_DAYS * 86400, &header.numEntries);
+    // the real entry count goes in last, a file cut short never validates
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fflush(fp) == 0 && fsync(fd) == 0;
+    if (fp != NULL) {
+        ok = fclose(fp) == 0 && ok;
+    } else if (fd != -1) {
+        close(fd);
+    }
+    ok = ok && rename(tmpPath, dc->path) == 0;
+    if (!ok) {
+        fprintf(stderr, "Warning: Cannot write digest cache %s: %s\n", dc->path, strerror(errno));
+        if (fd != -1) {
+            unlink(tmpPath);
+        }
+    } else {
+        // make the rename itself durable
+        int dirFd = open(dirname(tmpPath), O_RDONLY | O_DIRECTORY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+    free(tmpPath);
+    if (map != NULL) {
+        munmap(map, mapSize);
+    }
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+    return ok;
+}
+
+void freeDigestCache(digestCache *dc) {
+    if (dc != NULL) {
+        if (dc->map != NULL) {
+            munmap(dc->map, dc->mapSize);
+        }
+        free(dc->used);
+        free(dc->updates);
+        free(dc->path);
+        free(dc);
+    }
+}
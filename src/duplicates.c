@@ -9,10 +9,24 @@ struct option long_options[] = {
     {"hash", required_argument, NULL, 'd'},
     {"list", no_argument, NULL, 'l'},
     {"minimise", no_argument, NULL, 'm'},
+    {"stats", optional_argument, NULL, 's'},
+    {"jobs", required_argument, NULL, 'j'},
+    {"read-buffer", required_argument, NULL, 'B'},
+    {"read-mode", required_argument, NULL, 'M'},
+    {"keep-cache", no_argument, NULL, 'K'},
+    {"sha-kernel", required_argument, NULL, 'k'},
+    {"cache", required_argument, NULL, 'c'},
+    {"hash-algo", required_argument, NULL, 'H'},
+    {"byte-compare", no_argument, NULL, 'b'},
+    {"stream", no_argument, NULL, 'S'},
+    {"dry-run", no_argument, NULL, 'n'},
+    {"save-index", required_argument, NULL, 'o'},
+    {"load-index", required_argument, NULL, 'i'},
+    {"watch", required_argument, NULL, 'w'},
     {NULL, 0, NULL, 0}
 };
 
-#define OPTLIST "hraqf:d:lm"
+#define OPTLIST "hraqf:d:lms::j:B:M:Kk:c:H:bSno:i:w:"
 
 void usage(char *progname) {
     fprintf(stderr, "Usage: %s [options] <directory1> <directory2> ...\n", progname);
@@ -25,9 +39,62 @@ void usage(char *progname) {
     fprintf(stderr, "  -d, --hash <hash>\tOnly search for files with the given hash\n");
     fprintf(stderr, "  -l, --list\t\tList all duplicate files\n");
     fprintf(stderr, "  -m, --minimise\tMinimise the memory usage by hard linking duplicate files\n");
+    fprintf(stderr, "  -s, --stats[=text|json]\tPrint phase times, I/O counters and how many files each filtering stage left\n");
+    fprintf(stderr, "  -j, --jobs <n>\tScan and hash files on n worker threads (0 for one per CPU)\n");
+    fprintf(stderr, "  -B, --read-buffer <size>\tRead files in chunks of size bytes (K, M or G suffix, default 1M)\n");
+    fprintf(stderr, "  -M, --read-mode <mode>\tRead files with read, mmap, uring or auto (mmap for files of 16M and up)\n");
+    fprintf(stderr, "  -K, --keep-cache\tDo not drop hashed files from the page cache\n");
+    fprintf(stderr, "  -k, --sha-kernel <kernel>\tHash with the auto, scalar, shani, avx2 or armv8 SHA-256 kernel\n");
+    fprintf(stderr, "  -c, --cache <file>\tReuse digests of unchanged files from file, and save new ones to it\n");
+    fprintf(stderr, "  -H, --hash-algo <algo>\tCompare files by sha256, xxh128, blake3 or fast (xxh128 first, sha256 where it collides)\n");
+    fprintf(stderr, "  -b, --byte-compare	Compare candidate groups of up to 8 files byte by byte instead of hashing them\n");
+    fprintf(stderr, "  -S, --stream		List duplicate sets as soon as each batch of size groups is hashed, freeing them as it goes\n");
+    fprintf(stderr, "  -n, --dry-run		With -m, print the hard links that would be made without changing any file\n");
+    fprintf(stderr, "  -o, --save-index <file>\tSave every scanned file, its directory and its set to an index file\n");
+    fprintf(stderr, "  -i, --load-index <file>\tAnswer -d, -f, -l or the summary from an index file instead of scanning\n");
+    fprintf(stderr, "  -w, --watch <socket>\tKeep the sets up to date as files change and answer queries on a Unix socket\n");
     exit(EXIT_FAILURE);
 }
 
+int answerFromIndex(char *path, optionList *options) {
+    scanIndex *si = openScanIndex(path);
+    if (si == NULL) {
+        fprintf(stderr, "Error: Cannot load index %s\n", path);
+        return EXIT_FAILURE;
+    }
+    // digests are parsed and printed in the algorithm the index was made with
+    char algoName[sizeof(si->header->algo) + 1] = {0};
+    memcpy(algoName, si->header->algo, sizeof(si->header->algo));
+    hashAlgo algo;
+    if (!parseHashAlgo(algoName, &algo)) {
+        fprintf(stderr, "Error: Index %s holds digests of an unknown algorithm\n", path);
+        freeScanIndex(si);
+        return EXIT_FAILURE;
+    }
+    selectHashAlgo(algo);
+
+    if (getOption(options, 'd') == NULL && getOption(options, 'f') == NULL && getOption(options, 'l') == NULL) {
+        indexDefaultPrint(si, getOption(options, 'q') != NULL);
+    }
+    _option *optd = getOption(options, 'd');
+    if (optd != NULL) {
+        for (int i = 0; i < optd->numArgs; i++) {
+            indexListDuplicatesWithHash(si, optd->args[i]);
+        }
+    }
+    _option *optf = getOption(options, 'f');
+    if (optf != NULL) {
+        for (int i = 0; i < optf->numArgs; i++) {
+            indexListDuplicatesToFileNamed(si, optf->args[i]);
+        }
+    }
+    if (getOption(options, 'l') != NULL) {
+        indexListAllDuplicates(si);
+    }
+    freeScanIndex(si);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     char* progname = argv[0];
     if (argc < 2) {
@@ -63,6 +130,91 @@ int main(int argc, char *argv[]) {
             case 'm':
                 addOption(options, 'm', NULL);
                 break;
+            case 's': {
+                bool json;
+                if (!parseStatsFormat(optarg, &json)) {
+                    fprintf(stderr, "Error: Invalid stats format %s\n", optarg);
+                    freeOptionList(options);
+                    usage(progname);
+                }
+                addOption(options, 's', optarg);
+                break;
+            }
+            case 'j': {
+                char *end;
+                long numJobs = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || numJobs < 0 || numJobs > 1024) {
+                    fprintf(stderr, "Error: Invalid number of jobs %s\n", optarg);
+                    freeOptionList(options);
+                    usage(progname);
+                }
+                addOption(options, 'j', optarg);
+                break;
+            }
+            case 'B': {
+                size_t bufferSize;
+                if (!parseByteSize(optarg, &bufferSize) || bufferSize < READ_BUFFER_MIN || bufferSize > READ_BUFFER_MAX || bufferSize % READ_BUFFER_MIN != 0) {
+                    fprintf(stderr, "Error: Invalid read buffer size %s\n", optarg);
+                    freeOptionList(options);
+                    usage(progname);
+                }
+                addOption(options, 'B', optarg);
+                break;
+            }
+            case 'M': {
+                readStrategy strategy;
+                if (!parseReadStrategy(optarg, &strategy)) {
+                    fprintf(stderr, "Error: Invalid read mode %s\n", optarg);
+                    freeOptionList(options);
+                    usage(progname);
+                }
+                addOption(options, 'M', optarg);
+                break;
+            }
+            case 'K':
+                addOption(options, 'K', NULL);
+                break;
+            case 'k': {
+                sha256Kernel kernel;
+                if (!parseSha256Kernel(optarg, &kernel)) {
+                    fprintf(stderr, "Error: Invalid SHA-256 kernel %s\n", optarg);
+                    freeOptionList(options);
+                    usage(progname);
+                }
+                addOption(options, 'k', optarg);
+                break;
+            }
+            case 'H': {
+                hashAlgo algo;
+                if (!parseHashAlgo(optarg, &algo)) {
+                    fprintf(stderr, "Error: Invalid hash algorithm %s\n", optarg);
+                    freeOptionList(options);
+                    usage(progname);
+                }
+                addOption(options, 'H', optarg);
+                break;
+            }
+            case 'c':
+                addOption(options, 'c', optarg);
+                break;
+            case 'b':
+                addOption(options, 'b', NULL);
+                break;
+            case 'S':
+                addOption(options, 'S', NULL);
+                break;
+            case 'n':
+                addOption(options, 'n', NULL);
+                break;
+            case 'o':
+                addOption(options, 'o', optarg);
+                break;
+            case 'i':
+                addOption(options, 'i', optarg);
+                break;
+            case 'w':
+                addOption(options, 'w', optarg);
+                break;
             default:
                 freeOptionList(options);
                 usage(progname);
@@ -70,46 +222,123 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    hashTable *ht = initHashTable(HASH_TABLE_SIZE);
+    // sets are printed and freed batch by batch, so nothing is left to look up or link afterwards
+    bool stream = getOption(options, 'S') != NULL;
+    if (stream && (getOption(options, 'd') != NULL || getOption(options, 'f') != NULL || getOption(options, 'm') != NULL || getOption(options, 'o') != NULL)) {
+        fprintf(stderr, "Error: --stream cannot be combined with -d, -f, -m or -o\n");
+        freeOptionList(options);
+        usage(progname);
+    }
+
+    // the daemon answers its queries over the socket for as long as it runs
+    _option *optw = getOption(options, 'w');
+    if (optw != NULL && (getOption(options, 'd') != NULL || getOption(options, 'f') != NULL || getOption(options, 'l') != NULL || getOption(options, 'm') != NULL || stream || getOption(options, 'o') != NULL || getOption(options, 's') != NULL)) {
+        fprintf(stderr, "Error: --watch cannot be combined with -d, -f, -l, -m, -S, -o or -s\n");
+        freeOptionList(options);
+        usage(progname);
+    }
+
+    // an index answers the queries by itself, nothing is scanned
+    _option *opti = getOption(options, 'i');
+    if (opti != NULL) {
+        if (optind < argc || getOption(options, 'm') != NULL || stream || getOption(options, 'o') != NULL || getOption(options, 's') != NULL || getOption(options, 'w') != NULL) {
+            fprintf(stderr, "Error: --load-index takes no directories and cannot be combined with -m, -S, -o, -s or -w\n");
+            freeOptionList(options);
+            usage(progname);
+        }
+        int status = answerFromIndex(opti->args[opti->numArgs - 1], options);
+        freeOptionList(options);
+        return status;
+    }
+
+    // pick the SHA-256 kernel once, before any worker thread starts
+    sha256Kernel kernel = SHA256_AUTO;
+    _option *optk = getOption(options, 'k');
+    if (optk != NULL) {
+        parseSha256Kernel(optk->args[optk->numArgs - 1], &kernel);
+    }
+    if (!selectSha256Kernel(kernel)) {
+        fprintf(stderr, "Error: This CPU does not support the %s SHA-256 kernel\n", sha256KernelName(kernel));
+        freeOptionList(options);
+        exit(EXIT_FAILURE);
+    }
+    hashAlgo algo = HASH_SHA256;
+    _option *optH = getOption(options, 'H');
+    if (optH != NULL) {
+        parseHashAlgo(optH->args[optH->numArgs - 1], &algo);
+    }
+    selectHashAlgo(algo);
+
+    sizeTable *st = initSizeTable(SIZE_TABLE_SIZE, getNumJobs(options));
     SetCollection *sc = initSetCollection();
 
-    for (int i = optind; i < argc; i++) {
-        readDir(argv[i], ht, sc, options);
+    stageStats stats = {0};
+    phaseClock clock;
+    startPhaseClock(&clock);
+    readDirs(&argv[optind], argc - optind, st, sc, options);
+    stopPhaseClock(&clock, &stats.phases[PHASE_SCAN]);
+    startPhaseClock(&clock);
+    markCandidates(st, options, &stats);
+    stopPhaseClock(&clock, &stats.phases[PHASE_FINGERPRINT]);
+    if (stream) {
+        streamSizeGroups(st, options, &stats);
+    } else {
+        hashSizeGroups(st, sc, options, &stats);
+    }
+
+    if (optw != NULL) {
+        int status = watchDirs(optw->args[optw->numArgs - 1], st, sc, options);
+        freeSetCollection(sc);
+        freeSizeTable(st);
+        freeOptionList(options);
+        return status;
     }
 
-    if(getOption(options, 'd') == NULL && getOption(options, 'f') == NULL && getOption(options, 'l') == NULL && getOption(options, 'm') == NULL) {
+    startPhaseClock(&clock);
+
+    if(!stream && getOption(options, 'd') == NULL && getOption(options, 'f') == NULL && getOption(options, 'l') == NULL && getOption(options, 'm') == NULL) {
         defaultPrint(sc, options);
     }
 
     _option *optd = getOption(options, 'd'); 
     if (optd != NULL) {
         for (int i = 0; i < optd->numArgs; i++) {
-            listDuplicatesWithHash(optd->args[i], ht);
+            listDuplicatesWithHash(optd->args[i], sc);
         }
     }
 
     _option *optf = getOption(options, 'f');
     if (optf != NULL) {
         for (int i = 0; i < optf->numArgs; i++) {
-            listDuplicatesToFileNamed(optf->args[i], sc, ht);
+            listDuplicatesToFileNamed(optf->args[i], sc);
         }
     }
     
-    if (getOption(options, 'l') != NULL) {
+    if (!stream && getOption(options, 'l') != NULL) {
         listAllDuplicates(sc);
     }
 
+    // saved before -m, so the index describes the files as they were scanned
+    _option *opto = getOption(options, 'o');
+    if (opto != NULL) {
+        saveScanIndex(opto->args[opto->numArgs - 1], sc, hashAlgoName(getHashAlgo()));
+    }
+
     if (getOption(options, 'm') != NULL) {
-        minimiseMemoryUsage(sc);
+        minimiseMemoryUsage(sc, options);
+    }
+    stopPhaseClock(&clock, &stats.phases[PHASE_REPORT]);
+
+    if (getOption(options, 's') != NULL) {
+        printStageStats(&stats, st, sc, options);
     }
 
 
     // printOptionList(options);
-    // printHashTable(ht);
     // printSetCollection(sc);
 
-    freeHashTable(ht);
     freeSetCollection(sc);
+    freeSizeTable(st);
     freeOptionList(options);
 
     return 0;
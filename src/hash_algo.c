@@ -0,0 +1,90 @@
+#include "headers/hash_algo.h"
+
+
+static hashAlgo selectedAlgo = HASH_SHA256;
+
+char *hashAlgoName(hashAlgo algo) {
+    switch (algo) {
+        case HASH_XXH128:
+            return "xxh128";
+        case HASH_BLAKE3:
+            return "blake3";
+        case HASH_FAST:
+            return "fast";
+        default:
+            return "sha256";
+    }
+}
+
+bool parseHashAlgo(char *str, hashAlgo *algo) {
+    hashAlgo algos[] = {HASH_SHA256, HASH_XXH128, HASH_BLAKE3, HASH_FAST};
+    for (size_t i = 0; i < sizeof(algos) / sizeof(algos[0]); i++) {
+        if (strcmp(str, hashAlgoName(algos[i])) == 0) {
+            *algo = algos[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void selectHashAlgo(hashAlgo algo) {
+    selectedAlgo = algo;
+    selectXxh128Kernel();
+    selectBlake3Kernel();
+}
+
+hashAlgo getHashAlgo(void) {
+    return selectedAlgo;
+}
+
+const digestOps *getDigestOps(hashAlgo algo) {
+    switch (algo) {
+        case HASH_XXH128:
+            return &xxh128Ops;
+        case HASH_BLAKE3:
+            return &blake3Ops;
+        default:
+            return &sha256Ops;
+    }
+}
+
+void formatDigest(const sha2Digest *digest, char hex[SHA2_DIGEST_LEN_STR + 1]) {
+    digestToHex(digest, hex);
+    hex[2 * getDigestOps(selectedAlgo)->digestLen] = '\0';
+}
+
+bool parseDigest(const char *hex, sha2Digest *digest) {
+    // a shorter digest is parsed as if padded with zeros, which is how it is stored
+    size_t len = 2 * getDigestOps(selectedAlgo)->digestLen;
+    char padded[SHA2_DIGEST_LEN_STR + 1];
+    if (strlen(hex) != len) {
+        return false;
+    }
+    memset(padded, '0', SHA2_DIGEST_LEN_STR);
+    memcpy(padded, hex, len);
+    padded[SHA2_DIGEST_LEN_STR] = '\0';
+    return parseDigestHex(padded, digest);
+}
+
+// Digest being fed by readFileChunks (ops, ctx)
+typedef struct digestSink {
+    const digestOps *ops;
+    void *ctx;
+} digestSink;
+
+// read engine callback, feeds each chunk of the file to the digest
+static void consumeChunk(void *arg, unsigned char *buf, size_t len) {
+    digestSink *sink = arg;
+    sink->ops->update(sink->ctx, buf, len);
+}
+
+bool hashFile(const digestOps *ops, char *filename, readConfig *config, sha2Digest *digest) {
+    unsigned char ctx[DIGEST_CONTEXT_MAX] __attribute__((aligned(64)));
+    digestSink sink = {ops, ctx};
+    ops->init(ctx);
+    if (!readFileChunks(filename, config, consumeChunk, &sink)) {
+        return false;
+    }
+    ops->finish(ctx, digest);
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "base.h"
+
+#include <stdalign.h>
+#include <stddef.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// Arena chunk struct, one block that allocations are bumped out of (next, size, used, data)
+typedef struct arenaChunk {
+    struct arenaChunk *next;
+    size_t size;
+    size_t used;        // always a multiple of alignof(max_align_t)
+    alignas(max_align_t) char data[];
+} arenaChunk;
+
+// Arena struct, a list of chunks released all at once (head)
+typedef struct arena {
+    arenaChunk *head;   // the chunk currently being filled
+} arena;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to initialize a new, empty arena
+extern arena *initArena();
+
+// Function to allocate size bytes from an arena, aligned for any type (never returns NULL)
+extern void *arenaAlloc(arena *a, size_t size);
+
+// Function to copy a string into an arena
+extern char *arenaStrdup(arena *a, const char *str);
+
+// Function to free an arena and everything allocated from it
+extern void freeArena(arena *a);
+
+
+#endif // ARENA_H
@@ -14,6 +14,32 @@
 // Some Macros
 #define CHECK_ALLOC(ptr) if (ptr == NULL) { perror(__func__); exit(1); }
 
-#define HASH_TABLE_SIZE 997   // Prime num avoids clustering
+#define SET_INDEX_MIN_SLOTS 1024  // Power of two, the digest index doubles from here
+#define SIZE_TABLE_SIZE 65521 // Prime num, one bucket per size group
+#define INODE_MAP_MIN_SLOTS 1024  // Power of two, the inode map doubles from here
+
+#define ARENA_CHUNK_SIZE (1 << 20) // Bytes per arena chunk for scan records and paths, 1 MiB
+
+#define DIRENT_BUFFER_SIZE (1 << 16) // Bytes of directory entries fetched per getdents64 call, 64 KiB
+#define QUEUED_DIR_FDS_MAX 256       // Most queued directories held open at once, later ones are opened by path
+
+#define PARTIAL_BLOCK_SIZE 4096 // Bytes read from each end of a file for its partial fingerprint
+#define STREAM_BATCH_FILES 1024            // Candidate files hashed together before --stream prints their sets
+#define STREAM_BATCH_BYTES (256 << 20)      // Or fewer once they add up to this many bytes, 256 MiB
+#define COMPARE_MAX_FILES 8     // Most inodes of one size compared byte by byte with -b, bigger groups are hashed
+#define DIGEST_CACHE_EXPIRY_DAYS 30    // Days a -c cache entry is kept after the last run that used it, so deleted files age out
+#define ROTATIONAL_DEVICE_JOBS 1    // Threads reading one spinning disk at once, more would only make its head seek between files
+
+#define READ_BUFFER_SIZE (1 << 20)      // Default read() size when hashing, 1 MiB
+#define READ_BUFFER_MIN 4096            // Smallest read() size, one page
+#define READ_BUFFER_MAX (1 << 30)       // Largest read() size, 1 GiB
+#define MMAP_THRESHOLD (16 << 20)       // Files this big are mapped instead of read in auto mode, 16 MiB
+#define URING_QUEUE_DEPTH 32            // Files with a read in flight per io_uring thread
+#define URING_BUFFER_BUDGET (256 << 20) // Most memory for one io_uring thread's read buffers, 256 MiB
+
+#define WATCH_EVENT_BUFFER (1 << 16)    // Bytes of inotify events read at once by --watch, 64 KiB
+#define WATCH_MIN_BUCKETS 1024          // Power of two, the --watch name table doubles from here
+#define WATCH_QUERY_MAX 4096            // Longest --watch query line, including its newline
+#define WATCH_CLIENT_TIMEOUT 2          // Seconds a --watch client gets to send its query and to take the answer
 
 #endif // BASE_H
\ No newline at end of file
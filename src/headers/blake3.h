@@ -0,0 +1,43 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include "base.h"
+#include "strSHA2.h"
+
+#include <stdint.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024   // leaves of the tree, hashed independently of each other
+#define BLAKE3_MAX_DEPTH 54     // 2^54 chunks of 1 KiB is more than any file
+#define BLAKE3_CHUNKS_X8 8      // chunks the AVX2 kernel hashes side by side
+
+// Streaming BLAKE3 state (cv, chunkCounter, block, blockLen, blocksCompressed, cvStack, cvStackLen)
+typedef struct blake3Hasher {
+    uint32_t cv[8];             // chaining value of the chunk in progress
+    uint64_t chunkCounter;
+    unsigned char block[BLAKE3_BLOCK_LEN];
+    size_t blockLen;
+    size_t blocksCompressed;
+    uint32_t cvStack[BLAKE3_MAX_DEPTH][8];  // roots of the complete subtrees so far, one per set bit of chunkCounter
+    int cvStackLen;
+} blake3Hasher;
+
+// BLAKE3 as a streaming digest, 32 bytes
+extern const digestOps blake3Ops;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to pick the chunk kernel (AVX2 when the CPU has it); call before hashing starts
+extern void selectBlake3Kernel(void);
+
+// Functions to hash a stream: init, feed it any number of chunks, then write the 256-bit digest
+extern void blake3Init(blake3Hasher *hasher);
+extern void blake3Update(blake3Hasher *hasher, const unsigned char *input, size_t len);
+extern void blake3Final(blake3Hasher *hasher, sha2Digest *digest);
+
+
+#endif // BLAKE3_H
@@ -0,0 +1,14 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include "base.h"
+#include "read_engine.h"
+
+
+// FUNCTION PROTOTYPES
+
+// Function to split up to COMPARE_MAX_FILES files of one size into classes of identical contents by reading them side by side a chunk at a time, a file is closed as soon as no other file matches it (classOf[i] is the first file with the same contents as file i, -1 if it cannot be read)
+extern void compareFiles(char **paths, int numFiles, readConfig *config, int *classOf);
+
+
+#endif // COMPARE_H
@@ -3,36 +3,81 @@
 
 
 #include "base.h"
+#include "arena.h"
+#include "strSHA2.h"
 
+#include <stdint.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 
 // DEFINITIONS OF STRUCTS USED IN THE PROGRAM
 
-// Struct to store file info in a linked list (filename, path, hash, size, inode, next)
+// Path node struct, one scanned directory shared by everything under it, so a path is stored once however many files it holds (parent, length, name)
+typedef struct pathNode {
+    struct pathNode *parent;    // NULL for a directory named on the command line, whose name is its whole path
+    size_t length;              // of the full path, without the terminating null
+    char name[];
+} pathNode;
+
+// Struct to store file info (filename, dir, hash, hashed, compared, size, allocated, inode, device, mtime, ctime, partial, candidate, primary)
 typedef struct fileInfo {
-    char *filename;
-    char *path;
-    char *hash;
+    char *filename;     // stored right after the struct, the full path is dir/filename
+    pathNode *dir;
+    sha2Digest hash;    // valid once hashed is set
+    bool hashed;
+    int compared;       // byte compared class plus one, 0 if the file was hashed instead
     size_t size;
+    size_t allocated;   // bytes of disk blocks, less than size for a sparse file
     ino_t inode;
-    struct fileInfo *next;
+    dev_t device;
+    struct timespec mtime;
+    struct timespec ctime;
+    uint64_t partial;   // fingerprint of the first and last blocks
+    bool candidate;     // still may have a duplicate, so needs a full hash
+    struct fileInfo *primary;   // first scanned name of the same device and inode, NULL if this is it
 } fileInfo;
 
-// Hash table struct which will store buckets of fileInfo structs, each bucket/linked list is a set of duplicate files with the same hash
+// Inode map slot struct (device, inode, file)
+typedef struct inodeSlot {
+    dev_t device;
+    ino_t inode;
+    fileInfo *file;     // the inode's primary, NULL for an empty slot
+} inodeSlot;
 
-// Bucket struct to store a linked list of fileInfo structs (head, tail, numFiles)
-typedef struct bucket {
-    fileInfo *head;
-    fileInfo *tail;
-    int numFiles;
-} bucket;
+// Inode map struct, an open addressing (linear probing) index from device and inode to the first file scanned with them (slots, numSlots, numInodes)
+typedef struct inodeMap {
+    inodeSlot *slots;
+    int numSlots;   // power of two
+    int numInodes;
+} inodeMap;
 
-// Hash table struct to store buckets of fileInfo structs (buckets, size)
-typedef struct hashTable {
-    bucket **buckets;
+// Size table struct which groups scanned files by size before any of them are hashed
+
+// Size group struct to store the files sharing one size (size, files, numFiles, capacity, queried, next)
+typedef struct sizeGroup {
+    size_t size;
+    fileInfo **files;
+    int numFiles;
+    int capacity;
+    bool queried;   // holds a file named by a lone -f query, the only groups such a run reads
+    struct sizeGroup *next;
+} sizeGroup;
+
+// Size table struct to store chained size groups and every scanned file and directory in traversal order, plus the arenas the files live in and their inode map (buckets, size, files, numFiles, capacity, dirs, numDirs, dirCapacity, arenas, numArenas, inodes)
+typedef struct sizeTable {
+    sizeGroup **buckets;
     int size;
-} hashTable;
+    fileInfo **files;
+    int numFiles;
+    int capacity;
+    pathNode **dirs;    // what --watch subscribes to for changes
+    int numDirs;
+    int dirCapacity;
+    arena **arenas;     // one per scanning thread
+    int numArenas;
+    inodeMap *inodes;
+} sizeTable;
 
 // Option struct (flag, args, numArgs)
 typedef struct _option {
@@ -50,26 +95,58 @@ typedef struct optionList {
 
 // FUNCTION PROTOTYPES
 
-// Function to initialize a new fileInfo struct
-extern fileInfo *initFileInfo(char *filename, char *path, size_t size, ino_t inode);
+// Function to initialize a new pathNode struct in an arena for the directory name inside parent (NULL parent for a root, named by its whole path)
+extern pathNode *initPathNode(arena *a, pathNode *parent, const char *name);
+
+// Function to write a directory's full path into buf, which must hold node->length + 1 bytes
+extern void buildDirPath(pathNode *node, char *buf);
+
+// Function to initialize a new fileInfo struct in an arena for the file name inside dir, dir must live at least as long as the same arena (malloc'd on its own if a is NULL)
+extern fileInfo *initFileInfo(arena *a, pathNode *dir, const char *name, struct stat *statBuf);
+
+// Function to get the length of a file's full path, without the terminating null
+extern size_t filePathLength(fileInfo *file);
+
+// Function to write a file's full path into buf, rebuilt from its directory nodes (false if it needs more than bufSize bytes)
+extern bool buildFilePath(fileInfo *file, char *buf, size_t bufSize);
+
+// Function to rebuild a file's full path as a new string, for reports (the caller frees it)
+extern char *filePath(fileInfo *file);
 
 // Function to print the contents of a fileInfo struct
 extern void printFileInfo(fileInfo *file);
 
-// Function to free the memory allocated for a fileInfo struct
-extern void freeFileInfo(fileInfo *file);
+// Function to get the file owning a file's contents, the primary of its inode
+static inline fileInfo *inodeOwner(fileInfo *file) {
+    return file->primary != NULL ? file->primary : file;
+}
+
+// Function to initialize a new inodeMap struct
+extern inodeMap *initInodeMap();
+
+// Function to add a file to an inodeMap struct, setting its primary if an earlier file has the same device and inode
+extern void addFileInodeMap(inodeMap *im, fileInfo *file);
+
+// Function to free the memory allocated for an inodeMap struct
+extern void freeInodeMap(inodeMap *im);
+
+// Function to initialize a new sizeTable struct (array of chained sizeGroup structs) with an arena for each of numArenas threads
+extern sizeTable *initSizeTable(int size, int numArenas);
+
+// Function to add a scanned file to its size group and the inode map in a sizeTable struct
+extern void addFileSizeTable(sizeTable *st, fileInfo *file);
 
-// Function to initialize a new bucket struct (linked list of fileInfo structs)
-extern bucket *initBucket();
+// Function to record a scanned directory in a sizeTable struct
+extern void addDirSizeTable(sizeTable *st, pathNode *dir);
 
-// Function to initialize a new hashTable struct (array of bucket structs)
-extern hashTable *initHashTable(int size);
+// Function to take a file that is gone out of its size group, handing its inode over to its next name if it was the primary (files keeps it, as scanned)
+extern void removeFileSizeTable(sizeTable *st, fileInfo *file);
 
-// Function to print the contents of a hashTable struct
-extern void printHashTable(hashTable *ht);
+// Function to get the size group for the given size (NULL if no file has that size)
+extern sizeGroup *getSizeGroup(sizeTable *st, size_t size);
 
-// Function to free the memory allocated for a hashTable struct
-extern void freeHashTable(hashTable *ht);
+// Function to free the memory allocated for a sizeTable struct, including the arenas every fileInfo lives in
+extern void freeSizeTable(sizeTable *st);
 
 // Function to initialize a new optionList struct
 extern optionList *initOptionList();
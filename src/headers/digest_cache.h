@@ -0,0 +1,69 @@
+#ifndef DIGEST_CACHE_H
+#define DIGEST_CACHE_H
+
+#include "base.h"
+#include "data_structs.h"
+#include "strSHA2.h"
+
+#include <stdint.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+#define DIGEST_CACHE_MAGIC "DUPCACHE"
+#define DIGEST_CACHE_VERSION 3
+
+// Cache file header, followed by numEntries cacheEntry structs sorted by (device, inode) (magic, version, entrySize, numEntries, algo)
+typedef struct cacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;     // sizeof(cacheEntry) of the writer, a mismatch means a different layout
+    uint64_t numEntries;
+    char algo[8];           // name of the digest the entries hold, NUL padded
+} cacheHeader;
+
+// Cache entry struct, one file's digest and the stat fields it is only valid for (device, inode, size, mtime, ctime, seen, digest)
+typedef struct cacheEntry {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;      // nanoseconds since the epoch
+    int64_t ctime;      // nanoseconds since the epoch
+    int64_t seen;       // seconds since the epoch of the last run that hashed the file or used the entry
+    sha2Digest digest;
+} cacheEntry;
+
+// Digest cache struct, the mapped cache file plus the entries to write back (path, algo, map, mapSize, entries, numEntries, used, updates, numUpdates, capacity)
+typedef struct digestCache {
+    char *path;
+    char algo[8];
+    void *map;
+    size_t mapSize;
+    cacheEntry *entries;    // inside map, read only
+    size_t numEntries;
+    unsigned char *used;    // one flag per entry, set when a lookup returns its digest
+    cacheEntry *updates;
+    size_t numUpdates;
+    size_t capacity;
+} digestCache;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to map the cache file at path for digests of algo (a missing or unreadable file gives an empty cache, one of another algorithm NULL)
+extern digestCache *openDigestCache(char *path, char *algo);
+
+// Function to look up a file's digest, only if its device, inode, size, mtime and ctime all still match
+extern bool lookupDigestCache(digestCache *dc, fileInfo *file, sha2Digest *digest);
+
+// Function to record a hashed file's digest, to be written back by saveDigestCache
+extern void addDigestCache(digestCache *dc, fileInfo *file);
+
+// Function to merge the recorded digests into the cache file on disk, atomically and under a lock, dropping entries unused for DIGEST_CACHE_EXPIRY_DAYS
+extern bool saveDigestCache(digestCache *dc);
+
+// Function to unmap the cache file and free the memory allocated for a digestCache struct
+extern void freeDigestCache(digestCache *dc);
+
+
+#endif // DIGEST_CACHE_H
@@ -4,6 +4,8 @@
 
 #include "base.h"
 #include "read_dir.h"
+#include "scan_index.h"
+#include "watch.h"
 
 
 // FUNCTION PROTOTYPES
@@ -11,5 +13,8 @@
 // Print usage and help message
 extern void usage(char *progname);
 
+// Function to answer -d, -f, -l or the default summary from the index file at path, returns the exit status
+extern int answerFromIndex(char *path, optionList *options);
+
 
 #endif // DUPLICATES_H
\ No newline at end of file
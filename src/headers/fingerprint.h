@@ -0,0 +1,15 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include "base.h"
+
+#include <stdint.h>
+
+
+// FUNCTION PROTOTYPES
+
+// Function to fingerprint the first and last PARTIAL_BLOCK_SIZE bytes of a file of the given size
+extern bool partialFingerprint(char *filename, size_t size, uint64_t *fingerprint);
+
+
+#endif // FINGERPRINT_H
@@ -0,0 +1,49 @@
+#ifndef HASH_ALGO_H
+#define HASH_ALGO_H
+
+#include "base.h"
+#include "read_engine.h"
+#include "strSHA2.h"
+#include "xxh3.h"
+#include "blake3.h"
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// Digest used to tell file contents apart
+typedef enum hashAlgo {
+    HASH_SHA256,    // SHA-256, the default
+    HASH_XXH128,    // XXH3-128, not cryptographic but close to memory bandwidth
+    HASH_BLAKE3,    // BLAKE3, cryptographic and tree hashed so whole chunks go eight at a time
+    HASH_FAST       // XXH3-128 over every candidate, then SHA-256 only for files whose fast digests collide
+} hashAlgo;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to get the name of a hash algorithm
+extern char *hashAlgoName(hashAlgo algo);
+
+// Function to parse a hash algorithm name (sha256, xxh128, blake3 or fast)
+extern bool parseHashAlgo(char *str, hashAlgo *algo);
+
+// Function to pick the hash algorithm and its kernels; call before hashing starts
+extern void selectHashAlgo(hashAlgo algo);
+
+// Function to get the hash algorithm in use
+extern hashAlgo getHashAlgo(void);
+
+// Function to get the ops of the digest an algorithm reports (SHA-256 for fast)
+extern const digestOps *getDigestOps(hashAlgo algo);
+
+// Function to write a digest of the algorithm in use as lowercase hex and a NUL
+extern void formatDigest(const sha2Digest *digest, char hex[SHA2_DIGEST_LEN_STR + 1]);
+
+// Function to parse a hex digest of the algorithm in use (either case), false if it is not one
+extern bool parseDigest(const char *hex, sha2Digest *digest);
+
+// Function to hash a file with ops and the given read engine config, false if it cannot be read
+extern bool hashFile(const digestOps *ops, char *filename, readConfig *config, sha2Digest *digest);
+
+
+#endif // HASH_ALGO_H
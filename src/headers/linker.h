@@ -0,0 +1,38 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include "base.h"
+#include "data_structs.h"
+#include "workers.h"
+
+#include <sys/stat.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// What became of a planned link
+typedef enum linkResult {
+    LINK_PLANNED,       // checked and would be made, the outcome of a dry run
+    LINK_DONE,          // the duplicate's name now points at the original's inode
+    LINK_CROSS_DEVICE,  // the two files are on different devices, refused before touching either
+    LINK_CHANGED,       // either file's inode, size or mtime differs from the scan, left alone
+    LINK_SYMLINK,       // the duplicate's name is a symbolic link, left alone
+    LINK_FAILED         // linkat or renameat failed (error), the duplicate is left as it was
+} linkResult;
+
+// Link op struct, one duplicate name to point at the original's inode (original, dup, result, error)
+typedef struct linkOp {
+    fileInfo *original;
+    fileInfo *dup;
+    linkResult result;
+    int error;      // errno of the failed call for LINK_FAILED
+} linkOp;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to check and carry out link ops on numJobs threads, one directory of duplicates per job: each is linked under a temporary name next to it and renamed over it, so a failure never loses the duplicate (dryRun only checks)
+extern void runLinkOps(linkOp *ops, int numOps, bool dryRun, int numJobs);
+
+
+#endif // LINKER_H
@@ -4,46 +4,134 @@
 #include "base.h"
 #include "data_structs.h"
 #include "strSHA2.h"
+#include "hash_algo.h"
+#include "fingerprint.h"
+#include "compare.h"
+#include "linker.h"
+#include "digest_cache.h"
+#include "workers.h"
 
 #include <dirent.h>
+#include <limits.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 
 // DEFINITIONS OF STRUCTS USED IN THE PROGRAM
 
-// Set struct to store files with same hash in same set (hash, files, numFiles)
+// Set struct to store files with same hash in same set, in the order they were added (hash, files, numFiles, capacity, numInodes)
 typedef struct Set {
-    char *hash;
+    sha2Digest *hash;   // the first file's digest, NULL for an unhashed file or a set confirmed byte by byte
     fileInfo **files;
     int numFiles;
+    int capacity;
+    int numInodes;      // distinct device and inode pairs, numFiles less the extra hard links
 } Set;
 
-// SetCollection struct to store all sets of files (sets, numSets) - linked list of sets
+// Index slot struct, one digest's set in the open addressing index (tag, set)
+typedef struct setSlot {
+    uint64_t tag;   // first word of the digest, checked before touching the set
+    int set;        // index into sets plus one, 0 for an empty slot
+} setSlot;
+
+// SetCollection struct to store all sets of files in creation order, plus an open addressing (linear probing) index from digest to set (sets, numSets, capacity, slots, numSlots, numIndexed)
 typedef struct SetCollection {
     Set **sets;
     int numSets;
+    int capacity;
+    setSlot *slots;
+    int numSlots;   // power of two
+    int numIndexed;
 } SetCollection;
 
+// Directory entry struct, either a regular file or a subdirectory (file, dir)
+typedef struct dirEntry {
+    fileInfo *file;
+    struct dirNode *dir;
+} dirEntry;
+
+// Directory node struct to store one scanned directory and its entries in readdir order (path, fd, entries, numEntries, capacity, error)
+typedef struct dirNode {
+    pathNode *path;     // outlives the node, the files found in it keep pointing at it
+    int fd;     // opened relative to the parent when found, -1 to open by path
+    dirEntry *entries;
+    int numEntries;
+    int capacity;
+    int error;  // errno from opening the directory, 0 if it was read
+} dirNode;
+
+// Totals behind the default summary, whether counted from a scan or from a loaded index (numFiles, size, allocated, numUnique, uniqueSize, uniqueAllocated)
+typedef struct summaryTotals {
+    int numFiles;
+    size_t size;            // apparent size of every distinct inode, holes counted as data
+    size_t allocated;       // bytes of disk blocks of every distinct inode
+    int numUnique;          // one per set
+    size_t uniqueSize;
+    size_t uniqueAllocated;
+} summaryTotals;
+
+// Raw directory entry as returned by getdents64 (d_ino, d_off, d_reclen, d_type, d_name)
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Scan struct shared by the traversal threads (recursive, hidden, looseFiles, arenas, openDirs, maxOpenDirs)
+typedef struct scanOptions {
+    bool recursive;
+    bool hidden;
+    bool looseFiles;    // --stream frees file records one by one as it goes, so they are not put in the arenas
+    arena **arenas;     // indexed by thread
+    int openDirs;       // queued directories holding an fd, updated atomically
+    int maxOpenDirs;
+} scanOptions;
+
+// Struct to count the files left after each filtering stage and time each phase (scanned, queried, sizeCandidates, partialFingerprinted, partialCandidates, compared, comparedUnique, fastHashed, fastCandidates, fullHashed, cacheHits, linksShared, numDevices, rotationalDevices, phases)
+typedef struct stageStats {
+    int scanned;
+    int queried;        // files in the size groups a lone -f query needs, every scanned file otherwise
+    int sizeCandidates;
+    int partialFingerprinted;
+    int partialCandidates;
+    int compared;       // inodes read in lockstep by -b instead of being hashed
+    int comparedUnique; // of their names, the ones no other file matched
+    int fastHashed;     // files read for the XXH3-128 pass of --hash-algo fast
+    int fastCandidates; // candidates left after it, partialCandidates for any other algorithm
+    int fullHashed;
+    int cacheHits;      // digests taken from the --cache file instead of being hashed
+    int linksShared;    // hard links given their inode's digest instead of being hashed
+    int numDevices;     // devices the scanned files are on, each read from its own queue
+    int rotationalDevices;
+    phaseTime phases[NUM_PHASES];
+} stageStats;
+
 
 // FUNCTION PROTOTYPES
 
-// Hash function for allocating a bucket in the hash table
-extern unsigned long hash_function(char *str);
+// Hash function for picking a digest's first slot in the set index
+extern unsigned long hash_function(sha2Digest *digest);
 
 // Function to check if file is hidden
 extern bool isHidden(char *filename);
 
-// Function to add a file to the hash table
-extern bool addFileHashTable(hashTable *ht, fileInfo *file);
-
 // Function to initialize a new set
 extern Set *initSet();
 
 // Function to initialize a new set collection
 extern SetCollection *initSetCollection();
 
-// Function to add a file to a set in the set collection
-extern bool addFileSet(SetCollection *sc, fileInfo *file);
+// Function to find the set of files with the given digest (NULL if there is none)
+extern Set *findSet(SetCollection *sc, sha2Digest *digest);
+
+// Function to add a file to a set in the set collection, returning the set's index (a file without a hash gets a set of its own)
+extern int addFileSet(SetCollection *sc, fileInfo *file);
+
+// Function to take a file out of the set at the given index, which keeps its place in the collection even once empty
+extern void removeFileSet(SetCollection *sc, int set, fileInfo *file);
 
 // Function to free a set
 extern void freeSet(Set *set);
@@ -54,23 +142,62 @@ extern void freeSetCollection(SetCollection *sc);
 // Function to print the contents of a set collection
 extern void printSetCollection(SetCollection *sc);
 
-// Function to read a directory and add files to the hash table
-extern void readDir(char *dirPath, hashTable *ht, SetCollection *sc, optionList *optList);
+// Function to read one directory into its node, queueing subdirectories on the traversal pool
+extern void readDir(stealPool *pool, int thread, void *item);
+
+// Function to read all the root directories concurrently and record their files in the size table in depth-first order (nothing is hashed yet)
+extern void readDirs(char **dirPaths, int numDirs, sizeTable *st, SetCollection *sc, optionList *optList);
+
+// Function to mark the files that may still have a duplicate after the size and partial fingerprint stages
+extern void markCandidates(sizeTable *st, optionList *optList, stageStats *stats);
+
+// Function to get the number of worker threads to hash with (-j, 0 means one per online CPU)
+extern int getNumJobs(optionList *optList);
+
+// Function to get the read engine config for hashing (-B, -M and -K)
+extern readConfig getReadConfig(optionList *optList);
+
+// Function to hash the candidate files (reusing digests from the -c cache file, or comparing small groups byte by byte with -b) and add every scanned file to the set collection
+extern void hashSizeGroups(sizeTable *st, SetCollection *sc, optionList *optList, stageStats *stats);
+
+// Function to hash the candidate files a few size groups at a time, printing each batch's duplicate sets as soon as they are found and freeing them and their groups (--stream)
+extern void streamSizeGroups(sizeTable *st, optionList *optList, stageStats *stats);
+
+// Function to check a -s argument (none, text or json)
+extern bool parseStatsFormat(char *str, bool *json);
+
+// Function to print per-phase times, I/O counters, how many files each filtering stage left, index load and peak RSS to stderr (as one JSON line for -s json)
+extern void printStageStats(stageStats *stats, sizeTable *st, SetCollection *sc, optionList *optList);
+
+// Function to print the file counts and space savings of the default action (one line with -q)
+extern void printSummary(summaryTotals *totals, bool quiet);
+
+// Function to count the totals behind the default summary from a set collection
+extern void countSummary(SetCollection *sc, summaryTotals *totals);
 
 // Function for the default action of the program
 extern void defaultPrint(SetCollection *sc, optionList *optList);
 
 // Function to list the relative pathnames of all files with the given hash
-extern void listDuplicatesWithHash(char *hash, hashTable *ht);
+extern void listDuplicatesWithHash(char *hash, SetCollection *sc);
+
+// Function to print the files of the set found for a hash (NULL if there is none)
+extern void printDuplicatesWithHash(char *hash, Set *set);
 
 // Function to list the relative pathnames of all files duplicates to the file with the given name
-extern void listDuplicatesToFileNamed(char *filename, SetCollection *sc, hashTable *ht);
+extern void listDuplicatesToFileNamed(char *filename, SetCollection *sc);
+
+// Function to print the other files of the set holding the file with the given name (NULL if no file has it)
+extern void printDuplicatesToFileNamed(char *filename, Set *target);
+
+// Function to print one set of duplicate files under the given set number
+extern void printDuplicateSet(Set *set, int number);
 
 // Function to list all the sets of duplicate files
 extern void listAllDuplicates(SetCollection *sc);
 
-// Function to minimise memory usage by hard linking duplicate files
-extern void minimiseMemoryUsage(SetCollection *sc);
+// Function to minimise memory usage by hard linking duplicate files on the worker threads, or only print the plan with -n
+extern void minimiseMemoryUsage(SetCollection *sc, optionList *optList);
 
 
 #endif // READ_DIR_H
\ No newline at end of file
@@ -0,0 +1,94 @@
+#ifndef READ_ENGINE_H
+#define READ_ENGINE_H
+
+#include "base.h"
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+// lseek whences for finding holes, only declared by unistd.h with _GNU_SOURCE
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#define SEEK_HOLE 4
+#endif
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// How a file's contents are brought in for hashing
+typedef enum readStrategy {
+    READ_AUTO,  // read() for small files, mmap for files of at least mmapThreshold bytes
+    READ_READ,  // always read() into an aligned buffer
+    READ_MMAP,  // always mmap (read() if the mapping fails)
+    READ_URING  // io_uring, many reads in flight per thread (auto if io_uring is unavailable)
+} readStrategy;
+
+// Read config struct (strategy, bufferSize, mmapThreshold, dropCache)
+typedef struct readConfig {
+    readStrategy strategy;
+    size_t bufferSize;      // read() size, also the chunk size fed from a mapping
+    size_t mmapThreshold;
+    bool dropCache;         // POSIX_FADV_DONTNEED once a file is hashed
+} readConfig;
+
+// Read stream struct, one open file being read chunk by chunk (fd, size, config, map, buf, bufferSize, offset, sparse, dataStart, dataEnd)
+typedef struct readStream {
+    int fd;
+    size_t size;
+    readConfig *config;
+    unsigned char *map;     // whole-file mapping, NULL when reading
+    unsigned char *buf;     // aligned read buffer, NULL when mapped
+    size_t bufferSize;
+    size_t offset;          // bytes handed out so far
+    bool sparse;            // fewer blocks allocated than the size needs, so holes are skipped rather than read
+    size_t dataStart;       // the data extent at or after offset, everything before it is a hole
+    size_t dataEnd;
+} readStream;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to get the default read config
+extern readConfig defaultReadConfig();
+
+// Function to parse a byte count with an optional K, M or G suffix
+extern bool parseByteSize(char *str, size_t *size);
+
+// Function to get the name of a read strategy
+extern char *readStrategyName(readStrategy strategy);
+
+// Function to parse a read strategy name (auto, read, mmap or uring)
+extern bool parseReadStrategy(char *str, readStrategy *strategy);
+
+// Function to print the read config
+extern void printReadConfig(readConfig *config);
+
+// Function to check if a device is a spinning disk, from /sys/dev/block (false for solid state, virtual and unknown devices)
+extern bool isRotationalDevice(dev_t device);
+
+// Function to check from fstat whether a file has fewer blocks allocated than its size, and so may have holes
+extern bool isSparse(struct stat *statBuf);
+
+// Function to find the next data extent of a file at or after pos (dataStart == size if only a hole is left, the rest counts as data if the filesystem cannot tell)
+extern void findDataExtent(int fd, size_t pos, size_t size, size_t *dataStart, size_t *dataEnd);
+
+// Function to open a file for reading chunk by chunk, false if it cannot be opened
+extern bool openReadStream(readStream *rs, char *filename, readConfig *config);
+
+// Function to get the next chunk of a stream, every chunk but the last is bufferSize bytes and holes of a sparse file come back as zeros without being read (0 at end of file, -1 on error), a chunk of a mapped file must be read under guardMappedAccess
+extern ssize_t nextReadChunk(readStream *rs, unsigned char **chunk);
+
+// Function to run access(ctx) on chunks of mapped files, false with the address it faulted at if one of the files was truncated under it (SIGBUS)
+extern bool guardMappedAccess(void (*access)(void *ctx), void *ctx, void **faultAddress);
+
+// Function to check if an address is in a stream's mapping
+extern bool streamMapHolds(readStream *rs, void *address);
+
+// Function to close a stream, dropping the file from the page cache if configured
+extern void closeReadStream(readStream *rs);
+
+// Function to read a whole file and pass it to consume(ctx, buf, len) chunk by chunk, false if it cannot be opened or read
+extern bool readFileChunks(char *filename, readConfig *config, void (*consume)(void *ctx, unsigned char *buf, size_t len), void *ctx);
+
+
+#endif // READ_ENGINE_H
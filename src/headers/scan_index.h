@@ -0,0 +1,109 @@
+#ifndef SCAN_INDEX_H
+#define SCAN_INDEX_H
+
+#include "base.h"
+#include "data_structs.h"
+#include "read_dir.h"
+
+#include <stdint.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+#define SCAN_INDEX_MAGIC "DUPINDEX"
+#define SCAN_INDEX_VERSION 1
+#define INDEX_NO_PARENT UINT32_MAX  // parent of a directory named on the command line
+
+// Index file header, followed by its sections at the given offsets, each 8 byte aligned (magic, version, headerSize, dirSize, fileSize, setSize, algo, numDirs, numFiles, numSets, numHashedSets, namesSize, dirsOffset, filesOffset, setsOffset, byDigestOffset, byNameOffset, namesOffset)
+typedef struct indexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;    // the sizes of the writer's structs, a mismatch means a different layout
+    uint32_t dirSize;
+    uint32_t fileSize;
+    uint32_t setSize;
+    uint32_t reserved;
+    char algo[8];           // name of the digest the sets hold, NUL padded
+    uint64_t numDirs;
+    uint64_t numFiles;
+    uint64_t numSets;
+    uint64_t numHashedSets;
+    uint64_t namesSize;
+    uint64_t dirsOffset;    // indexDir[numDirs]
+    uint64_t filesOffset;   // indexFile[numFiles], grouped by set in set order
+    uint64_t setsOffset;    // indexSet[numSets], in the order the scan reported them
+    uint64_t byDigestOffset;    // uint32_t[numHashedSets], the sets with a digest sorted by it
+    uint64_t byNameOffset;  // uint32_t[numFiles], the files sorted by name and then by position
+    uint64_t namesOffset;   // NUL terminated names, namesSize bytes
+} indexHeader;
+
+// Index directory struct, one scanned directory (name, parent)
+typedef struct indexDir {
+    uint64_t name;      // offset into the names, the whole path for a directory named on the command line
+    uint32_t parent;    // index of the directory holding it, INDEX_NO_PARENT for a root
+    uint32_t reserved;
+} indexDir;
+
+// Index file struct, one scanned file (size, allocated, inode, device, name, dir, set)
+typedef struct indexFile {
+    uint64_t size;
+    uint64_t allocated;
+    uint64_t inode;
+    uint64_t device;
+    uint64_t name;      // offset into the names
+    uint32_t dir;
+    uint32_t set;
+} indexFile;
+
+// Index set struct, one set of identical files (digest, firstFile, allocated, numFiles, numInodes, hashed)
+typedef struct indexSet {
+    sha2Digest digest;  // valid if hashed
+    uint64_t firstFile;
+    uint64_t allocated;     // bytes of disk blocks of its distinct inodes
+    uint32_t numFiles;
+    uint32_t numInodes;
+    uint32_t hashed;        // 0 for an unhashed file or a set confirmed byte by byte
+    uint32_t reserved;
+} indexSet;
+
+// Scan index struct, a mapped index file used in place (map, mapSize, header, dirs, files, sets, byDigest, byName, names, nodes, nodeArena)
+typedef struct scanIndex {
+    void *map;
+    size_t mapSize;
+    indexHeader *header;
+    indexDir *dirs;
+    indexFile *files;
+    indexSet *sets;
+    uint32_t *byDigest;
+    uint32_t *byName;
+    char *names;
+    pathNode **nodes;   // directories turned into path nodes so far, by index
+    arena *nodeArena;
+} scanIndex;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to write every file of a set collection, its directory tree and its sets to an index file, atomically (algo is the digest the sets hold)
+extern bool saveScanIndex(char *path, SetCollection *sc, char *algo);
+
+// Function to map an index file read only and check its header (NULL if it is missing or not a valid index)
+extern scanIndex *openScanIndex(char *path);
+
+// Function to print the default summary from an index
+extern void indexDefaultPrint(scanIndex *si, bool quiet);
+
+// Function to list the files with the given hash from an index
+extern void indexListDuplicatesWithHash(scanIndex *si, char *hash);
+
+// Function to list the duplicates of the file with the given name from an index
+extern void indexListDuplicatesToFileNamed(scanIndex *si, char *filename);
+
+// Function to list all the sets of duplicate files in an index
+extern void indexListAllDuplicates(scanIndex *si);
+
+// Function to unmap an index file and free the memory allocated for a scanIndex struct
+extern void freeScanIndex(scanIndex *si);
+
+
+#endif // SCAN_INDEX_H
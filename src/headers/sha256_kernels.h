@@ -0,0 +1,46 @@
+#ifndef SHA256_KERNELS_H
+#define SHA256_KERNELS_H
+
+#include "base.h"
+
+#include <stdint.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// SHA-256 compression kernels, picked at startup from what the CPU supports
+typedef enum sha256Kernel {
+    SHA256_AUTO,    // the best kernel the CPU supports
+    SHA256_SCALAR,  // portable C
+    SHA256_SHANI,   // x86 SHA extensions
+    SHA256_AVX2,    // x86 AVX2, eight files hashed side by side
+    SHA256_ARMV8    // ARMv8 SHA2 instructions
+} sha256Kernel;
+
+// Number of messages the multi-buffer kernel hashes side by side
+#define SHA256_LANES 8
+
+
+// FUNCTION PROTOTYPES
+
+// Functions to check at runtime whether the CPU (and OS) support each kernel
+extern bool cpuHasShaNi(void);
+extern bool cpuHasAvx2(void);
+extern bool cpuHasArmv8Sha2(void);
+
+// Function to get the name of a kernel
+extern char *sha256KernelName(sha256Kernel kernel);
+
+// Function to parse a kernel name (auto, scalar, shani, avx2 or armv8)
+extern bool parseSha256Kernel(char *str, sha256Kernel *kernel);
+
+// Functions to run the compression function over blocks 64-byte blocks, updating state
+extern void sha256_blocks_scalar(uint32_t state[8], const unsigned char *data, size_t blocks);
+extern void sha256_blocks_shani(uint32_t state[8], const unsigned char *data, size_t blocks);
+extern void sha256_blocks_armv8(uint32_t state[8], const unsigned char *data, size_t blocks);
+
+// Function to run the compression function over blocks blocks of SHA256_LANES independent messages at once
+extern void sha256_blocks_x8(uint32_t *states[SHA256_LANES], const unsigned char *data[SHA256_LANES], size_t blocks);
+
+
+#endif // SHA256_KERNELS_H
@@ -0,0 +1,72 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "base.h"
+
+#include <stdint.h>
+#include <time.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// Phases of a run, in the order they happen
+typedef enum runPhase {
+    PHASE_SCAN,         // directory traversal and stat
+    PHASE_FINGERPRINT,  // size grouping and partial fingerprints
+    PHASE_HASH,         // full hashes (and digest cache lookups)
+    PHASE_GROUP,        // sorting files into sets by digest
+    PHASE_REPORT,       // printing results, hard linking for -m
+    NUM_PHASES
+} runPhase;
+
+// Time spent in one phase, CPU time is summed over all threads (wall, cpu)
+typedef struct phaseTime {
+    double wall;
+    double cpu;
+} phaseTime;
+
+// Clock struct holding the start of the phase being timed (wall, cpu)
+typedef struct phaseClock {
+    struct timespec wall;
+    double cpu;
+} phaseClock;
+
+// I/O counters, each thread counts into its own copy and adds it to the totals when it finishes (directories, entries, statCalls, filesOpened, bytesRead, holeBytes)
+typedef struct ioCounters {
+    uint64_t directories;
+    uint64_t entries;
+    uint64_t statCalls;
+    uint64_t filesOpened;
+    uint64_t bytesRead;
+    uint64_t holeBytes;     // holes of sparse files hashed as zeros without being read
+} ioCounters;
+
+// This thread's counters, plain adds with no sharing between threads
+extern __thread ioCounters threadCounters;
+
+// Some Macros
+#define COUNT_IO(field, n) (threadCounters.field += (n))
+
+
+// FUNCTION PROTOTYPES
+
+// Function to get the name of a phase
+extern char *phaseName(runPhase phase);
+
+// Function to start timing a phase
+extern void startPhaseClock(phaseClock *clock);
+
+// Function to add the time since startPhaseClock to a phase's total
+extern void stopPhaseClock(phaseClock *clock, phaseTime *time);
+
+// Function to add this thread's counters to the totals and reset them, called by each thread as it finishes
+extern void flushThreadCounters(void);
+
+// Function to get the totals, including the calling thread's counts
+extern void getIoCounters(ioCounters *counters);
+
+// Function to get the peak resident set size of the process in KiB
+extern long peakRssKb(void);
+
+
+#endif // STATS_H
@@ -2,8 +2,65 @@
 #define SHA2_H
 
 #include "base.h"
+#include "read_engine.h"
+#include "sha256_kernels.h"
+#include "uring.h"
+
+#include <stdint.h>
+
+#define SHA2_DIGEST_LEN_BYTES 32
+#define SHA2_DIGEST_LEN_STR 64
+
+// SHA-256 of zero bytes, used for empty files without opening them
+#define SHA2_EMPTY_STR "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+
+// Binary SHA-256 digest, stored as four words so comparing two digests is four word compares (words)
+typedef struct sha2Digest {
+    uint64_t words[4];
+} sha2Digest;
+
+// Streaming digest struct, one hash algorithm's entry points; contexts are at most DIGEST_CONTEXT_MAX bytes (name, digestLen, ctxSize, init, update, finish)
+typedef struct digestOps {
+    char *name;
+    size_t digestLen;   // bytes of the digest that are used, the rest of a sha2Digest stays zero
+    size_t ctxSize;
+    void (*init)(void *ctx);
+    void (*update)(void *ctx, const unsigned char *buf, size_t len);
+    void (*finish)(void *ctx, sha2Digest *digest);
+} digestOps;
+
+#define DIGEST_CONTEXT_MAX 2048
+
+// SHA-256 as a streaming digest, through the selected compression kernel
+extern const digestOps sha256Ops;
+
+// Function to compare two digests
+static inline bool digestEqual(const sha2Digest *a, const sha2Digest *b) {
+    return ((a->words[0] ^ b->words[0]) | (a->words[1] ^ b->words[1]) | (a->words[2] ^ b->words[2]) | (a->words[3] ^ b->words[3])) == 0;
+}
+
+// Function to write a digest as 64 lowercase hex characters and a NUL
+extern void digestToHex(const sha2Digest *digest, char hex[SHA2_DIGEST_LEN_STR + 1]);
+
+// Function to parse a 64 character hex digest (either case), false if it is not one
+extern bool parseDigestHex(const char *hex, sha2Digest *digest);
 
 extern char *strSHA2(char *filename);
 
+// Function to hash a file with the given read engine config, false if it cannot be read
+extern bool sha2File(char *filename, readConfig *config, sha2Digest *digest);
+
+// Function to pick the compression kernel (SHA256_AUTO for the best the CPU supports), false if the CPU lacks it; call before hashing starts
+extern bool selectSha256Kernel(sha256Kernel kernel);
+
+// Function to get the kernel in use
+extern sha256Kernel getSha256Kernel(void);
+
+// Function to hash files multi-buffer, taking indexes from the shared counter next until numFiles; hashed[i] is false if filenames[i] cannot be read
+extern void sha2FileLanes(char **filenames, sha2Digest *digests, bool *hashed, int *next, int numFiles, readConfig *config);
+
+// Function to hash files with ops through an io_uring read pipeline, taking indexes like sha2FileLanes; false if io_uring cannot be set up or fails, leaving the indexes not yet taken to the caller
+extern bool hashFilesUring(const digestOps *ops, char **filenames, sha2Digest *digests, bool *hashed, int *next, int numFiles, readConfig *config);
+
 
 #endif // SHA2_H
\ No newline at end of file
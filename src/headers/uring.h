@@ -0,0 +1,66 @@
+#ifndef URING_H
+#define URING_H
+
+#include "base.h"
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// io_uring instance struct, the mapped submission and completion rings (fd, sqHead, sqTail, sqMask, sqArray, sqes, sqEntries, toSubmit, cqHead, cqTail, cqMask, cqes, sqMap, sqMapSize, cqMap, cqMapSize, sqesSize, fixedBuffers)
+typedef struct uring {
+    int fd;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned sqEntries;
+    unsigned toSubmit;      // entries queued since the last io_uring_enter
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqMap;
+    size_t sqMapSize;
+    void *cqMap;            // the same as sqMap with IORING_FEAT_SINGLE_MMAP
+    size_t cqMapSize;
+    size_t sqesSize;
+    bool fixedBuffers;      // buffers were registered, reads use IORING_OP_READ_FIXED
+} uring;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to check once whether io_uring can be set up here (a kernel without it or a seccomp filter says no)
+extern bool uringAvailable(void);
+
+// Function to set up an io_uring instance with room for entries submissions, false if the kernel refuses
+extern bool initUring(uring *ring, unsigned entries);
+
+// Function to register the read buffers with the kernel, false (reads then use plain IORING_OP_READ) if it refuses
+extern bool registerUringBuffers(uring *ring, struct iovec *iovs, unsigned numIovs);
+
+// Function to queue a read of len bytes at offset into buffer bufIndex, false if the submission ring is full
+extern bool queueUringRead(uring *ring, int fd, void *buf, unsigned len, uint64_t offset, int bufIndex, uint64_t userData);
+
+// Function to submit every queued read in one call and wait for at least minComplete completions (negative errno on failure)
+extern int submitUring(uring *ring, unsigned minComplete);
+
+// Function to wait for at least minComplete completions without submitting anything (negative errno on failure)
+extern int waitUring(uring *ring, unsigned minComplete);
+
+// Function to take back the last read queued but not submitted yet, false if there is none
+extern bool unqueueUringRead(uring *ring, uint64_t *userData);
+
+// Function to take the next completion off the ring, false if there is none
+extern bool nextUringCompletion(uring *ring, uint64_t *userData, int *res);
+
+// Function to tear down an io_uring instance
+extern void freeUring(uring *ring);
+
+
+#endif // URING_H
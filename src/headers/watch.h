@@ -0,0 +1,64 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "base.h"
+#include "arena.h"
+#include "data_structs.h"
+#include "hash_algo.h"
+#include "read_dir.h"
+#include "read_engine.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// Events every watched directory is subscribed to: a file written and closed, a name created, deleted or moved in or out
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+// Watched file struct, one live name and the set it is in (file, set, next)
+typedef struct watchedFile {
+    fileInfo *file;
+    int set;        // index into the set collection
+    struct watchedFile *next;   // next name in the same bucket
+} watchedFile;
+
+// Watcher struct, the scan kept up to date by the daemon between queries (st, sc, ops, config, recursive, hidden, inotifyFd, listenFd, stdoutFd, dirs, numDirs, buckets, numBuckets, numFiles, freeFiles, totals, totalsValid, outOfWatches)
+typedef struct watcher {
+    sizeTable *st;
+    SetCollection *sc;
+    const digestOps *ops;
+    readConfig config;
+    bool recursive;
+    bool hidden;
+    int inotifyFd;
+    int listenFd;
+    int stdoutFd;       // the real stdout, while it points at a client
+    pathNode **dirs;    // indexed by watch descriptor, NULL once a directory is no longer watched
+    int numDirs;
+    watchedFile **buckets;  // chained by file name, so -f queries and path lookups both start from one bucket
+    int numBuckets;     // power of two
+    int numFiles;
+    watchedFile *freeFiles;     // records of removed names, reused before the arena grows
+    summaryTotals totals;
+    bool totalsValid;   // cleared by every change, the summary is only counted again when asked for
+    bool outOfWatches;  // the inotify watch limit was hit and reported
+} watcher;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to keep a scanned tree's sets up to date from inotify events and answer queries on a Unix socket until SIGINT or SIGTERM (--watch)
+extern int watchDirs(char *socketPath, sizeTable *st, SetCollection *sc, optionList *optList);
+
+
+#endif // WATCH_H
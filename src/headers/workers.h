@@ -0,0 +1,76 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "base.h"
+#include "stats.h"
+
+#include <pthread.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+// Job struct shared by the worker threads (work, arg, numItems, next)
+typedef struct workerJob {
+    void (*work)(void *arg, int item);
+    void *arg;
+    int numItems;
+    int next;   // next item to hand out, taken atomically
+} workerJob;
+
+// Work queue struct, the items of one device and how many threads may take from it at once (items, numItems, next, limit, active)
+typedef struct workQueue {
+    int *items;
+    int numItems;
+    int next;       // next item to hand out, taken atomically
+    int limit;
+    int active;     // threads working on it, changed under the job's lock
+} workQueue;
+
+// Job struct shared by the worker threads of several queues (work, arg, queues, numQueues, lock)
+typedef struct queuedJob {
+    void (*work)(void *arg, int item);
+    void *arg;
+    workQueue *queues;
+    int numQueues;
+    pthread_mutex_t lock;
+} queuedJob;
+
+// Deque struct, the owning thread pushes and pops at the bottom and other threads steal from the top (items, capacity, top, count, lock)
+typedef struct workDeque {
+    void **items;
+    int capacity;
+    int top;
+    int count;
+    pthread_mutex_t lock;
+} workDeque;
+
+// Work-stealing pool struct, one deque per thread (deques, numThreads, work, arg, pending, queued, idle, idleLock, wake)
+typedef struct stealPool {
+    workDeque *deques;
+    int numThreads;
+    void (*work)(struct stealPool *pool, int thread, void *item);
+    void *arg;
+    int pending;    // items pushed but not yet finished
+    int queued;     // items sitting in a deque
+    int idle;       // threads waiting for work
+    pthread_mutex_t idleLock;
+    pthread_cond_t wake;
+} stealPool;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to run work(arg, i) for every item i in [0, numItems) on numThreads threads, returns once all items are done
+extern void runWorkers(int numThreads, void (*work)(void *arg, int item), void *arg, int numItems);
+
+// Function to run work(arg, item) for every item of every queue on numThreads threads, never more than a queue's limit on it at once, returns once all items are done
+extern void runQueuedWorkers(int numThreads, void (*work)(void *arg, int item), void *arg, workQueue *queues, int numQueues);
+
+// Function to push a new item onto the deque of the given thread, callable from inside work()
+extern void pushStealPool(stealPool *pool, int thread, void *item);
+
+// Function to run work(pool, thread, item) on numThreads threads, starting from the seed items, until no work is left (work may push more items)
+extern void runStealPool(int numThreads, void (*work)(stealPool *pool, int thread, void *item), void *arg, void **seeds, int numSeeds);
+
+
+#endif // WORKERS_H
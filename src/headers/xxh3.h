@@ -0,0 +1,39 @@
+#ifndef XXH3_H
+#define XXH3_H
+
+#include "base.h"
+#include "strSHA2.h"
+
+#include <stdint.h>
+
+
+// DEFINITIONS OF STRUCTS USED IN THE PROGRAM
+
+#define XXH3_STRIPE_LEN 64
+#define XXH3_BUFFER_SIZE 256    // four stripes, inputs up to 240 bytes are hashed whole from here
+
+// Streaming XXH3-128 state, seed 0 and the default secret (acc, buffer, bufferedSize, stripesSoFar, totalLen)
+typedef struct xxh128State {
+    uint64_t acc[8];
+    unsigned char buffer[XXH3_BUFFER_SIZE];
+    size_t bufferedSize;    // never 0 once past the first buffer, the last stripe is always held back
+    size_t stripesSoFar;    // stripes into the current block of the secret
+    uint64_t totalLen;
+} xxh128State;
+
+// XXH3-128 as a streaming digest, 16 bytes in canonical (big endian) order
+extern const digestOps xxh128Ops;
+
+
+// FUNCTION PROTOTYPES
+
+// Function to pick the accumulate loop (AVX2 when the CPU has it); call before hashing starts
+extern void selectXxh128Kernel(void);
+
+// Functions to hash a stream: reset, feed it any number of chunks, then write the 128-bit digest
+extern void xxh128Reset(xxh128State *state);
+extern void xxh128Update(xxh128State *state, const unsigned char *input, size_t len);
+extern void xxh128Digest(xxh128State *state, sha2Digest *digest);
+
+
+#endif // XXH3_H
@@ -0,0 +1,126 @@
+#include "headers/linker.h"
+
+#include <limits.h>
+
+
+// Job struct for the linking workers, one directory of duplicates per item (ops, order, runs, dryRun)
+typedef struct linkWork {
+    linkOp *ops;
+    linkOp **order;     // ops sorted by the duplicate's directory node
+    int *runs;          // where each directory starts in order, plus the end
+    bool dryRun;
+} linkWork;
+
+// every scanned directory has one node, so files in the same directory share the pointer
+static int compareDirs(const void *a, const void *b) {
+    uintptr_t da = (uintptr_t)(*(linkOp **)a)->dup->dir;
+    uintptr_t db = (uintptr_t)(*(linkOp **)b)->dup->dir;
+    return (da > db) - (da < db);
+}
+
+// the name still leads to the file that was scanned: same device, inode, size and mtime
+static bool unchanged(struct stat *statBuf, fileInfo *file) {
+    return statBuf->st_dev == file->device && statBuf->st_ino == file->inode && (size_t)statBuf->st_size == file->size
+        && statBuf->st_mtim.tv_sec == file->mtime.tv_sec && statBuf->st_mtim.tv_nsec == file->mtime.tv_nsec;
+}
+
+// point one duplicate at the original, the rename replaces it in one step so it is never missing
+static void linkOne(int dirFd, linkOp *op, int serial, bool dryRun) {
+    char original[PATH_MAX];
+    if (!buildFilePath(op->original, original, sizeof(original))) {
+        op->error = ENAMETOOLONG;
+        op->result = LINK_FAILED;
+        return;
+    }
+    // the original is followed like the scan followed it, and linked through below
+    struct stat originalBuf, dupBuf;
+    COUNT_IO(statCalls, 2);
+    if (fstatat(AT_FDCWD, original, &originalBuf, 0) == -1 || !unchanged(&originalBuf, op->original)
+        || fstatat(dirFd, op->dup->filename, &dupBuf, AT_SYMLINK_NOFOLLOW) == -1) {
+        op->result = LINK_CHANGED;
+        return;
+    }
+    // the rename would turn a symlinked duplicate into a regular file, so it is left as the user made it
+    if (S_ISLNK(dupBuf.st_mode)) {
+        op->result = LINK_SYMLINK;
+        return;
+    }
+    if (!unchanged(&dupBuf, op->dup)) {
+        op->result = LINK_CHANGED;
+        return;
+    }
+    if (dryRun) {
+        op->result = LINK_PLANNED;
+        return;
+    }
+    // a fixed pattern rather than the duplicate's name, which may already be as long as a name can be
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), ".duplicates-%d-%d.tmp", (int)getpid(), serial);
+    if (linkat(AT_FDCWD, original, dirFd, tmp, AT_SYMLINK_FOLLOW) == -1) {
+        op->error = errno;
+        op->result = LINK_FAILED;
+        return;
+    }
+    if (renameat(dirFd, tmp, dirFd, op->dup->filename) == -1) {
+        op->error = errno;
+        op->result = LINK_FAILED;
+        unlinkat(dirFd, tmp, 0);
+        return;
+    }
+    op->result = LINK_DONE;
+}
+
+// worker job: open one directory once and link every duplicate in it
+static void linkDirJob(void *arg, int item) {
+    linkWork *work = arg;
+    linkOp **ops = &work->order[work->runs[item]];
+    int numOps = work->runs[item + 1] - work->runs[item];
+    char dir[PATH_MAX];
+    int dirFd = -1, error = ENAMETOOLONG;
+    if (ops[0]->dup->dir->length < sizeof(dir)) {
+        buildDirPath(ops[0]->dup->dir, dir);
+        dirFd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        error = errno;
+    }
+    for (int i = 0; i < numOps; i++) {
+        if (dirFd == -1) {
+            ops[i]->error = error;
+            ops[i]->result = LINK_FAILED;
+            continue;
+        }
+        linkOne(dirFd, ops[i], ops[i] - work->ops, work->dryRun);
+    }
+    if (dirFd != -1) {
+        close(dirFd);
+    }
+}
+
+void runLinkOps(linkOp *ops, int numOps, bool dryRun, int numJobs) {
+    // a hard link cannot cross devices, so those pairs are refused before anything is touched
+    linkOp **order = malloc((numOps + 1) * sizeof(linkOp *));
+    CHECK_ALLOC(order);
+    int numOrdered = 0;
+    for (int i = 0; i < numOps; i++) {
+        if (ops[i].original->device != ops[i].dup->device) {
+            ops[i].result = LINK_CROSS_DEVICE;
+        } else {
+            order[numOrdered++] = &ops[i];
+        }
+    }
+    qsort(order, numOrdered, sizeof(linkOp *), compareDirs);
+    int *runs = malloc((numOrdered + 1) * sizeof(int));
+    CHECK_ALLOC(runs);
+    int numRuns = 0;
+    for (int i = 0; i < numOrdered; i++) {
+        if (i == 0 || compareDirs(&order[i - 1], &order[i]) != 0) {
+            runs[numRuns++] = i;
+        }
+    }
+    runs[numRuns] = numOrdered;
+
+    // each directory belongs to one thread, so renames in it never race each other
+    linkWork work = {ops, order, runs, dryRun};
+    runWorkers(numJobs, linkDirJob, &work, numRuns);
+    free(order);
+    free(runs);
+}
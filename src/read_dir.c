@@ -1,38 +1,15 @@
 #include "headers/read_dir.h"
 
 
-unsigned long hash_function(char *str) {
-    // djb2 hash function by Dan Bernstein
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    return hash;
+unsigned long hash_function(sha2Digest *digest) {
+    // every digest we use is already uniformly distributed, its first word will do
+    return digest->words[0];
 }
 
 bool isHidden(char *filename) {
     return filename[0] == '.';
 }
 
-bool addFileHashTable(hashTable *ht, fileInfo *file) {
-    char *fileHash = strSHA2(file->path);
-    if (fileHash == NULL) {
-        return false;
-    }
-    file->hash = fileHash;
-    // use fileHash to determine which bucket to add the file to
-    unsigned long index = hash_function(fileHash) % ht->size;
-    if (ht->buckets[index]->head == NULL) {
-        ht->buckets[index]->head = file;
-        ht->buckets[index]->tail = file;
-    } else {
-        ht->buckets[index]->tail->next = file;
-        ht->buckets[index]->tail = file;
-    }
-    ht->buckets[index]->numFiles++;
-    return true;
-}
-
 Set *initSet() {
     Set *newSet = calloc(1, sizeof(Set));
     CHECK_ALLOC(newSet);
@@ -42,34 +19,113 @@ Set *initSet() {
 SetCollection *initSetCollection() {
     SetCollection *sc = calloc(1, sizeof(SetCollection));
     CHECK_ALLOC(sc);
+    sc->numSlots = SET_INDEX_MIN_SLOTS;
+    sc->slots = calloc(sc->numSlots, sizeof(setSlot));
+    CHECK_ALLOC(sc->slots);
     return sc;
 }
 
-bool addFileSet(SetCollection *sc, fileInfo *file) {
-    char *fileHash = file->hash;
-    if (fileHash == NULL) {
-        return false;
+// Probe for the digest's slot: either the slot holding its set or the empty slot it would go in
+static setSlot *probeSetIndex(SetCollection *sc, sha2Digest *digest) {
+    unsigned long mask = sc->numSlots - 1;
+    unsigned long index = hash_function(digest) & mask;
+    while (sc->slots[index].set != 0) {
+        setSlot *slot = &sc->slots[index];
+        // the tag rules out almost every other digest without a trip to the set itself
+        if (slot->tag == digest->words[0] && digestEqual(sc->sets[slot->set - 1]->hash, digest)) {
+            return slot;
+        }
+        index = (index + 1) & mask;
     }
-    for (int i = 0; i < sc->numSets; i++) {
-        if (strcmp(sc->sets[i]->hash, fileHash) == 0) {
-            sc->sets[i]->numFiles++;
-            sc->sets[i]->files = realloc(sc->sets[i]->files, sc->sets[i]->numFiles * sizeof(fileInfo *));
-            CHECK_ALLOC(sc->sets[i]->files);
-            sc->sets[i]->files[sc->sets[i]->numFiles - 1] = file;
-            return true;
+    return &sc->slots[index];
+}
+
+// Double the index once it is 70% full, keeping probe sequences short
+static void growSetIndex(SetCollection *sc) {
+    setSlot *oldSlots = sc->slots;
+    int oldNumSlots = sc->numSlots;
+    sc->numSlots *= 2;
+    sc->slots = calloc(sc->numSlots, sizeof(setSlot));
+    CHECK_ALLOC(sc->slots);
+    for (int i = 0; i < oldNumSlots; i++) {
+        if (oldSlots[i].set != 0) {
+            *probeSetIndex(sc, sc->sets[oldSlots[i].set - 1]->hash) = oldSlots[i];
+        }
+    }
+    free(oldSlots);
+}
+
+Set *findSet(SetCollection *sc, sha2Digest *digest) {
+    setSlot *slot = probeSetIndex(sc, digest);
+    return slot->set != 0 ? sc->sets[slot->set - 1] : NULL;
+}
+
+// Append a file to a set, counting it as another inode if it is its inode's primary
+static void appendSetFile(Set *set, fileInfo *file) {
+    if (set->numFiles == set->capacity) {
+        set->capacity = set->capacity == 0 ? 1 : set->capacity * 2;
+        set->files = realloc(set->files, set->capacity * sizeof(fileInfo *));
+        CHECK_ALLOC(set->files);
+    }
+    set->files[set->numFiles++] = file;
+    set->numInodes += file->primary == NULL;
+}
+
+// Append a set to the collection without indexing it
+static void pushSet(SetCollection *sc, Set *set) {
+    if (sc->numSets == sc->capacity) {
+        sc->capacity = sc->capacity == 0 ? 64 : sc->capacity * 2;
+        sc->sets = realloc(sc->sets, sc->capacity * sizeof(Set *));
+        CHECK_ALLOC(sc->sets);
+    }
+    sc->sets[sc->numSets++] = set;
+}
+
+int addFileSet(SetCollection *sc, fileInfo *file) {
+    // an unhashed file has a unique size, so it can only be in a set by itself and is never indexed
+    setSlot *slot = NULL;
+    if (file->hashed) {
+        slot = probeSetIndex(sc, &file->hash);
+        if (slot->set != 0) {
+            // every name of an inode hashes the same, so its primary was added to this set first
+            appendSetFile(sc->sets[slot->set - 1], file);
+            return slot->set - 1;
         }
     }
     Set *newSet = initSet();
-    newSet->hash = fileHash;
-    newSet->files = calloc(1, sizeof(fileInfo *));
-    CHECK_ALLOC(newSet->files);
-    newSet->files[0] = file;
-    newSet->numFiles = 1;
-    sc->sets = realloc(sc->sets, (sc->numSets + 1) * sizeof(Set *));
-    CHECK_ALLOC(sc->sets);
-    sc->sets[sc->numSets] = newSet;
-    sc->numSets++;
-    return true;
+    newSet->hash = file->hashed ? &file->hash : NULL;
+    appendSetFile(newSet, file);
+    newSet->numInodes = 1;
+    pushSet(sc, newSet);
+    if (slot != NULL) {
+        slot->tag = file->hash.words[0];
+        slot->set = sc->numSets;
+        sc->numIndexed++;
+        if ((long)sc->numIndexed * 10 > (long)sc->numSlots * 7) {
+            growSetIndex(sc);
+        }
+    }
+    return sc->numSets - 1;
+}
+
+void removeFileSet(SetCollection *sc, int set, fileInfo *file) {
+    Set *target = sc->sets[set];
+    int i = 0;
+    while (i < target->numFiles && target->files[i] != file) {
+        i++;
+    }
+    if (i == target->numFiles) {
+        return;
+    }
+    memmove(&target->files[i], &target->files[i + 1], (target->numFiles - i - 1) * sizeof(fileInfo *));
+    target->numFiles--;
+    // the inode stays in the set as long as another of its names does
+    for (int j = 0; j < target->numFiles; j++) {
+        if (inodeOwner(target->files[j]) == inodeOwner(file)) {
+            return;
+        }
+    }
+    target->numInodes--;
 }
 
 void freeSet(Set *set) {
@@ -89,6 +145,7 @@ void freeSetCollection(SetCollection *sc) {
             }
             free(sc->sets);
         }
+        free(sc->slots);
         free(sc);
     }
 }
@@ -96,7 +153,11 @@ void freeSetCollection(SetCollection *sc) {
 void printSetCollection(SetCollection *sc) {
     printf("SET COLLECTION:\n\n");
     for (int i = 0; i < sc->numSets; i++) {
-        printf("Set %d (%d) [%s]:\n", i + 1, sc->sets[i]->numFiles, sc->sets[i]->hash);
+        char hex[SHA2_DIGEST_LEN_STR + 1] = "(none)";
+        if (sc->sets[i]->hash != NULL) {
+            formatDigest(sc->sets[i]->hash, hex);
+        }
+        printf("Set %d (%d) [%s]:\n", i + 1, sc->sets[i]->numFiles, hex);
         printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
         for (int j = 0; j < sc->sets[i]->numFiles; j++) {
             printFileInfo(sc->sets[i]->files[j]);
@@ -108,252 +169,1359 @@ void printSetCollection(SetCollection *sc) {
     printf("-------------------------------------------------------------------------------------\n");
 }
 
-void readDir(char *dirPath, hashTable *ht, SetCollection *sc, optionList *optList) {
-    DIR *dir = opendir(dirPath);
-    if (dir == NULL) {
-        perror(dirPath);
-        freeHashTable(ht);
-        freeSetCollection(sc);
-        freeOptionList(optList);
-        exit(EXIT_FAILURE);        
+// the path node is not copied, it lives in an arena for as long as the files under it
+static dirNode *initDirNode(pathNode *path) {
+    dirNode *node = calloc(1, sizeof(dirNode));
+    CHECK_ALLOC(node);
+    node->path = path;
+    node->fd = -1;
+    return node;
+}
+
+static void addDirEntry(dirNode *node, fileInfo *file, dirNode *dir) {
+    if (node->numEntries == node->capacity) {
+        node->capacity = node->capacity == 0 ? 16 : node->capacity * 2;
+        node->entries = realloc(node->entries, node->capacity * sizeof(dirEntry));
+        CHECK_ALLOC(node->entries);
     }
+    node->entries[node->numEntries++] = (dirEntry){file, dir};
+}
 
-    // each directory entry
-    struct dirent *entry;
+// free a directory tree, its paths belong to the size table's arenas and so do its files unless withFiles (loose --stream records)
+static void freeDirNode(dirNode *node, bool withFiles) {
+    for (int i = 0; i < node->numEntries; i++) {
+        if (node->entries[i].dir != NULL) {
+            freeDirNode(node->entries[i].dir, withFiles);
+        } else if (withFiles) {
+            free(node->entries[i].file);
+        }
+    }
+    free(node->entries);
+    free(node);
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        // skip . and .. directories
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+// the first unreadable directory in depth-first order, the one the serial scan would have stopped at
+static dirNode *firstDirError(dirNode *node) {
+    if (node->error != 0) {
+        return node;
+    }
+    for (int i = 0; i < node->numEntries; i++) {
+        if (node->entries[i].dir != NULL) {
+            dirNode *failed = firstDirError(node->entries[i].dir);
+            if (failed != NULL) {
+                return failed;
+            }
+        }
+    }
+    return NULL;
+}
+
+// add the files in depth-first readdir order, as if the tree had been read recursively on one thread
+static void flattenDirNode(dirNode *node, sizeTable *st) {
+    addDirSizeTable(st, node->path);
+    for (int i = 0; i < node->numEntries; i++) {
+        if (node->entries[i].dir != NULL) {
+            flattenDirNode(node->entries[i].dir, st);
+        } else {
+            addFileSizeTable(st, node->entries[i].file);
+        }
+    }
+}
+
+// a directory's full path as a new string, only needed to open it without its parent or to report it
+static char *dirPath(pathNode *node) {
+    char *path = malloc(node->length + 1);
+    CHECK_ALLOC(path);
+    buildDirPath(node, path);
+    return path;
+}
+
+void readDir(stealPool *pool, int thread, void *item) {
+    dirNode *node = item;
+    scanOptions *options = pool->arg;
+    arena *a = options->arenas[thread];
+    // the parent opened this directory when it found it, unless it ran out of descriptors
+    int dirFd = node->fd;
+    if (dirFd != -1) {
+        __atomic_fetch_sub(&options->openDirs, 1, __ATOMIC_RELAXED);
+    } else {
+        char *path = dirPath(node->path);
+        dirFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        free(path);
+    }
+    if (dirFd == -1) {
+        // reported once the traversal is over, threads cannot exit on their own
+        node->error = errno;
+        return;
+    }
+    COUNT_IO(directories, 1);
+    char *buf = malloc(DIRENT_BUFFER_SIZE);
+    CHECK_ALLOC(buf);
+
+    // read the entries in large batches, in the same order readdir would return them
+    long numRead;
+    while ((numRead = syscall(SYS_getdents64, dirFd, buf, DIRENT_BUFFER_SIZE)) > 0) {
+        for (long offset = 0; offset < numRead; ) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buf + offset);
+            offset += entry->d_reclen;
+            // skip . and .. directories
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            COUNT_IO(entries, 1);
+            // the entry type saves a stat for directories and for hidden files that would be skipped anyway
+            if (entry->d_type == DT_DIR && !options->recursive) {
+                continue;
+            }
+            if (entry->d_type == DT_REG && !options->hidden && isHidden(entry->d_name)) {
+                continue;
+            }
+            bool isDir = entry->d_type == DT_DIR;
+            struct stat fileStatBuf;
+            if (!isDir) {
+                // stat relative to the directory, following symlinks like stat() on the path did
+                COUNT_IO(statCalls, 1);
+                if (fstatat(dirFd, entry->d_name, &fileStatBuf, 0) == -1) {
+                    char *path = dirPath(node->path);
+                    fprintf(stderr, "Error: Cannot get file information for %s/%s\n", path, entry->d_name);
+                    free(path);
+                    continue;
+                }
+                isDir = S_ISDIR(fileStatBuf.st_mode);
+                // anything but a directory or a regular file is skipped
+                if (!isDir && !S_ISREG(fileStatBuf.st_mode)) {
+                    continue;
+                }
+            }
+
+            // if entry is a directory
+            if (isDir) {
+                // if the recursive flag is set, queue the directory for whichever thread gets to it first
+                if (options->recursive) {
+                    dirNode *child = initDirNode(initPathNode(a, node->path, entry->d_name));
+                    // open it relative to this one now so its path is never walked again, while the budget allows
+                    if (__atomic_add_fetch(&options->openDirs, 1, __ATOMIC_RELAXED) <= options->maxOpenDirs) {
+                        child->fd = openat(dirFd, entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    }
+                    if (child->fd == -1) {
+                        __atomic_fetch_sub(&options->openDirs, 1, __ATOMIC_RELAXED);
+                    }
+                    addDirEntry(node, NULL, child);
+                    pushStealPool(pool, thread, child);
+                }
+            }
+            // if entry is a regular file
+            else {
+                // if the hidden flag is not set, skip hidden files
+                if (!options->hidden && isHidden(entry->d_name)) {
+                    continue;
+                }
+                fileInfo *newFile = initFileInfo(options->looseFiles ? NULL : a, node->path, entry->d_name, &fileStatBuf);
+                // only record the file here, hashing waits until all sizes are known
+                addDirEntry(node, newFile, NULL);
+            }
+        }
+    }
+    if (numRead == -1) {
+        char *path = dirPath(node->path);
+        fprintf(stderr, "Error: Cannot read directory %s\n", path);
+        free(path);
+    }
+    free(buf);
+    close(dirFd);
+}
+
+void readDirs(char **dirPaths, int numDirs, sizeTable *st, SetCollection *sc, optionList *optList) {
+    scanOptions options = {getOption(optList, 'r') != NULL, getOption(optList, 'a') != NULL, getOption(optList, 'S') != NULL, st->arenas, 0, QUEUED_DIR_FDS_MAX};
+    // leave most descriptors for the hashing threads and the directories being read
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 4 < QUEUED_DIR_FDS_MAX) {
+        options.maxOpenDirs = limit.rlim_cur / 4;
+    }
+    dirNode **roots = calloc(numDirs + 1, sizeof(dirNode *));
+    CHECK_ALLOC(roots);
+    for (int i = 0; i < numDirs; i++) {
+        roots[i] = initDirNode(initPathNode(st->arenas[0], NULL, dirPaths[i]));
+    }
+
+    runStealPool(st->numArenas, readDir, &options, (void **)roots, numDirs);
+
+    for (int i = 0; i < numDirs; i++) {
+        dirNode *failed = firstDirError(roots[i]);
+        if (failed != NULL) {
+            char *path = dirPath(failed->path);
+            fprintf(stderr, "%s: %s\n", path, strerror(failed->error));
+            free(path);
+            for (int j = 0; j < numDirs; j++) {
+                // --stream records were malloc'd one by one and never reached the size table
+                freeDirNode(roots[j], options.looseFiles);
+            }
+            free(roots);
+            freeSizeTable(st);
+            freeSetCollection(sc);
+            freeOptionList(optList);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < numDirs; i++) {
+        flattenDirNode(roots[i], st);
+        freeDirNode(roots[i], false);
+    }
+    free(roots);
+}
+
+int getNumJobs(optionList *optList) {
+    _option *optj = getOption(optList, 'j');
+    if (optj == NULL) {
+        return 1;
+    }
+    int numJobs = atoi(optj->args[optj->numArgs - 1]);
+    if (numJobs == 0) {
+        long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+        numJobs = numCPUs > 0 ? (int)numCPUs : 1;
+    }
+    return numJobs;
+}
+
+// copy the partial fingerprint (or its failure) from each file's primary, which was fingerprinted in its place
+static void copyPrimaryPartial(fileInfo *file) {
+    if (file->primary != NULL) {
+        file->partial = file->primary->partial;
+        file->candidate = file->primary->candidate;
+    }
+}
+
+// Item of a spinning disk's queue with the inode it is read through (inode, item)
+typedef struct inodeItem {
+    ino_t inode;
+    int item;
+} inodeItem;
+
+static int compareInodeItem(const void *a, const void *b) {
+    ino_t ia = ((inodeItem *)a)->inode;
+    ino_t ib = ((inodeItem *)b)->inode;
+    return (ia > ib) - (ia < ib);
+}
+
+// split items into one queue per device in order of first appearance, files[item] being the file each reads: a spinning disk
+// takes ROTATIONAL_DEVICE_JOBS threads at a time and gets its items in inode order, which mostly follows their place on it
+static int buildDeviceQueues(fileInfo **files, int numItems, int numJobs, workQueue **queues) {
+    // a scan rarely spans more than a few devices, so a list searched from the last hit will do
+    dev_t *devices = malloc((numItems + 1) * sizeof(dev_t));
+    CHECK_ALLOC(devices);
+    int *queueOf = malloc((numItems + 1) * sizeof(int));
+    CHECK_ALLOC(queueOf);
+    int numQueues = 0, last = 0;
+    for (int i = 0; i < numItems; i++) {
+        if (numQueues == 0 || devices[last] != files[i]->device) {
+            last = 0;
+            while (last < numQueues && devices[last] != files[i]->device) {
+                last++;
+            }
+            if (last == numQueues) {
+                devices[numQueues++] = files[i]->device;
+            }
         }
-        // get full path of the file
-        char *fullPath = calloc(strlen(dirPath) + strlen(entry->d_name) + 2, sizeof(char));
-        CHECK_ALLOC(fullPath);
-        sprintf(fullPath, "%s/%s", dirPath, entry->d_name);
-        struct stat fileStatBuf;
-        // if cannot get file information, report error and skip the file
-        if (stat(fullPath, &fileStatBuf) == -1) {
-            fprintf(stderr, "Error: Cannot get file information for %s\n", fullPath);
-            free(fullPath);
+        queueOf[i] = last;
+    }
+    *queues = calloc(numQueues + 1, sizeof(workQueue));
+    CHECK_ALLOC(*queues);
+    for (int i = 0; i < numItems; i++) {
+        (*queues)[queueOf[i]].numItems++;
+    }
+    bool *rotational = malloc((numQueues + 1) * sizeof(bool));
+    CHECK_ALLOC(rotational);
+    for (int q = 0; q < numQueues; q++) {
+        workQueue *queue = &(*queues)[q];
+        queue->items = malloc(queue->numItems * sizeof(int));
+        CHECK_ALLOC(queue->items);
+        rotational[q] = isRotationalDevice(devices[q]);
+        queue->limit = rotational[q] ? ROTATIONAL_DEVICE_JOBS : numJobs;
+        queue->numItems = 0;
+    }
+    for (int i = 0; i < numItems; i++) {
+        workQueue *queue = &(*queues)[queueOf[i]];
+        queue->items[queue->numItems++] = i;
+    }
+    for (int q = 0; q < numQueues; q++) {
+        workQueue *queue = &(*queues)[q];
+        if (!rotational[q]) {
             continue;
         }
+        inodeItem *sorted = malloc(queue->numItems * sizeof(inodeItem));
+        CHECK_ALLOC(sorted);
+        for (int i = 0; i < queue->numItems; i++) {
+            sorted[i] = (inodeItem){files[queue->items[i]]->inode, queue->items[i]};
+        }
+        qsort(sorted, queue->numItems, sizeof(inodeItem), compareInodeItem);
+        for (int i = 0; i < queue->numItems; i++) {
+            queue->items[i] = sorted[i].item;
+        }
+        free(sorted);
+    }
+    free(devices);
+    free(queueOf);
+    free(rotational);
+    return numQueues;
+}
+
+static void freeDeviceQueues(workQueue *queues, int numQueues) {
+    for (int q = 0; q < numQueues; q++) {
+        free(queues[q].items);
+    }
+    free(queues);
+}
+
+// run work(arg, item) for numItems items on numJobs threads, every device busy at once but a spinning disk read by one thread at a time
+static void runDeviceWorkers(int numJobs, void (*work)(void *arg, int item), void *arg, fileInfo **files, int numItems) {
+    workQueue *queues;
+    int numQueues = buildDeviceQueues(files, numItems, numJobs, &queues);
+    runQueuedWorkers(numJobs, work, arg, queues, numQueues);
+    freeDeviceQueues(queues, numQueues);
+}
+
+// worker job: fingerprint one file, unreadable files are left to the full hash which reports the error
+static void fingerprintJob(void *arg, int item) {
+    fileInfo *file = ((fileInfo **)arg)[item];
+    // a path too long for PATH_MAX could not be opened anyway
+    char path[PATH_MAX];
+    if (!buildFilePath(file, path, sizeof(path)) || !partialFingerprint(path, file->size, &file->partial)) {
+        file->candidate = true;
+    }
+}
+
+readConfig getReadConfig(optionList *optList) {
+    readConfig config = defaultReadConfig();
+    // options were validated while parsing, the last one given wins
+    _option *optB = getOption(optList, 'B');
+    if (optB != NULL) {
+        parseByteSize(optB->args[optB->numArgs - 1], &config.bufferSize);
+    }
+    _option *optM = getOption(optList, 'M');
+    if (optM != NULL) {
+        parseReadStrategy(optM->args[optM->numArgs - 1], &config.strategy);
+    }
+    if (getOption(optList, 'K') != NULL) {
+        config.dropCache = false;
+    }
+    // checked at runtime, the kernel or a seccomp filter may refuse io_uring
+    if (config.strategy == READ_URING && !uringAvailable()) {
+        config.strategy = READ_AUTO;
+    }
+    return config;
+}
+
+// Job struct for the hashing workers (ops, files, paths, digests, hashed, next, numFiles, config)
+typedef struct hashWork {
+    const digestOps *ops;
+    fileInfo **files;
+    char **paths;       // multi-buffer and io_uring only
+    sha2Digest *digests;    // multi-buffer and io_uring only
+    bool *hashed;       // multi-buffer and io_uring only
+    int next;           // multi-buffer and io_uring only, shared by all lane sets or rings
+    int numFiles;
+    readConfig *config;
+} hashWork;
 
-        // if entry is a directory
-        if (S_ISDIR(fileStatBuf.st_mode)) {
-            // if the recursive flag is set, recursively read the directory
-            if (getOption(optList, 'r') != NULL) {
-                readDir(fullPath, ht, sc, optList);
+// worker job: hash one file, each job only writes to its own fileInfo
+static void hashJob(void *arg, int item) {
+    hashWork *work = arg;
+    fileInfo *file = work->files[item];
+    char path[PATH_MAX];
+    file->hashed = buildFilePath(file, path, sizeof(path)) && hashFile(work->ops, path, work->config, &file->hash);
+}
+
+// worker job: one set of multi-buffer lanes per thread on a device, each pulling that device's files until none are left
+static void hashLanesJob(void *arg, int item) {
+    hashWork *work = ((hashWork **)arg)[item];
+    sha2FileLanes(work->paths, work->digests, work->hashed, &work->next, work->numFiles, work->config);
+}
+
+// worker job: one io_uring pipeline per thread on a device, each pulling that device's files until none are left
+static void hashUringJob(void *arg, int item) {
+    hashWork *work = ((hashWork **)arg)[item];
+    if (hashFilesUring(work->ops, work->paths, work->digests, work->hashed, &work->next, work->numFiles, work->config)) {
+        return;
+    }
+    // this thread could not get a ring of its own, or lost it, so it hashes the rest of its share synchronously
+    int i;
+    while ((i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->numFiles) {
+        work->hashed[i] = hashFile(work->ops, work->paths[i], work->config, &work->digests[i]);
+    }
+}
+
+static int comparePartial(const void *a, const void *b) {
+    uint64_t pa = (*(fileInfo **)a)->partial;
+    uint64_t pb = (*(fileInfo **)b)->partial;
+    return (pa > pb) - (pa < pb);
+}
+
+// a -f query with nothing else to report only needs the duplicates of the files it names
+static bool isFileQuery(optionList *optList) {
+    return getOption(optList, 'f') != NULL && getOption(optList, 'd') == NULL && getOption(optList, 'l') == NULL && getOption(optList, 'm') == NULL && getOption(optList, 'o') == NULL;
+}
+
+// mark the size groups of the files a lone -f query names, false if every group is needed
+static bool markQueriedGroups(sizeTable *st, optionList *optList, stageStats *stats) {
+    if (!isFileQuery(optList)) {
+        stats->queried = st->numFiles;
+        return false;
+    }
+    _option *optf = getOption(optList, 'f');
+    for (int i = 0; i < st->numFiles; i++) {
+        for (int j = 0; j < optf->numArgs; j++) {
+            if (strcmp(st->files[i]->filename, optf->args[j]) == 0) {
+                sizeGroup *group = getSizeGroup(st, st->files[i]->size);
+                stats->queried += group->queried ? 0 : group->numFiles;
+                group->queried = true;
+                break;
             }
-        } 
-        // if entry is a regular file
-        else if (S_ISREG(fileStatBuf.st_mode)) {
-            // if the hidden flag is not set, skip hidden files
-            if (getOption(optList, 'a') == NULL && isHidden(entry->d_name)) {
-                free(fullPath);
+        }
+    }
+    return true;
+}
+
+// the devices the scanned files are on, each of which gets its own queue when files are read
+static void countDevices(sizeTable *st, int *numDevices, int *numRotational) {
+    dev_t *devices = malloc((st->numFiles + 1) * sizeof(dev_t));
+    CHECK_ALLOC(devices);
+    *numDevices = 0;
+    *numRotational = 0;
+    for (int i = 0; i < st->numFiles; i++) {
+        int d = 0;
+        while (d < *numDevices && devices[d] != st->files[i]->device) {
+            d++;
+        }
+        if (d == *numDevices) {
+            devices[(*numDevices)++] = st->files[i]->device;
+            *numRotational += isRotationalDevice(st->files[i]->device);
+        }
+    }
+    free(devices);
+}
+
+void markCandidates(sizeTable *st, optionList *optList, stageStats *stats) {
+    stats->scanned = st->numFiles;
+    if (getOption(optList, 's') != NULL) {
+        countDevices(st, &stats->numDevices, &stats->rotationalDevices);
+    }
+    bool query = markQueriedGroups(st, optList, stats);
+
+    // collect every file that needs a partial fingerprint so the workers can share them out
+    fileInfo **work = malloc((st->numFiles + 1) * sizeof(fileInfo *));   // +1 so an empty scan still allocates
+    CHECK_ALLOC(work);
+    int numWork = 0;
+    for (int i = 0; i < st->size; i++) {
+        for (sizeGroup *group = st->buckets[i]; group != NULL; group = group->next) {
+            if (group->numFiles < 2 || (query && !group->queried)) {
                 continue;
             }
-            fileInfo *newFile = initFileInfo(entry->d_name, fullPath, fileStatBuf.st_size, fileStatBuf.st_ino);
+            stats->sizeCandidates += group->numFiles;
+            // empty files and files that fit in the two blocks gain nothing from a partial read
+            if (group->size <= 2 * PARTIAL_BLOCK_SIZE) {
+                for (int j = 0; j < group->numFiles; j++) {
+                    group->files[j]->candidate = true;
+                }
+                continue;
+            }
+            // each inode is read once, through its primary
+            for (int j = 0; j < group->numFiles; j++) {
+                if (group->files[j]->primary == NULL) {
+                    work[numWork++] = group->files[j];
+                }
+            }
+        }
+    }
+    runDeviceWorkers(getNumJobs(optList), fingerprintJob, work, work, numWork);
+    for (int i = 0; i < numWork; i++) {
+        stats->partialFingerprinted += !work[i]->candidate;
+    }
+    free(work);
 
-            if (!addFileHashTable(ht, newFile)) {
-                fprintf(stderr, "Error: Cannot add file %s to hash table\n", fullPath);
-                freeFileInfo(newFile);
+    for (int i = 0; i < st->size; i++) {
+        for (sizeGroup *group = st->buckets[i]; group != NULL; group = group->next) {
+            if (group->numFiles < 2 || (query && !group->queried)) {
+                continue;
             }
-            if (!addFileSet(sc, newFile)) {
-                fprintf(stderr, "Error: Cannot add file %s to set collection\n", fullPath);
-                freeFileInfo(newFile);
+            if (group->size > 2 * PARTIAL_BLOCK_SIZE) {
+                for (int j = 0; j < group->numFiles; j++) {
+                    copyPrimaryPartial(group->files[j]);
+                }
+                // sort a copy so equal fingerprints are adjacent, the group keeps its traversal order
+                fileInfo **sorted = malloc(group->numFiles * sizeof(fileInfo *));
+                CHECK_ALLOC(sorted);
+                memcpy(sorted, group->files, group->numFiles * sizeof(fileInfo *));
+                qsort(sorted, group->numFiles, sizeof(fileInfo *), comparePartial);
+                for (int j = 1; j < group->numFiles; j++) {
+                    if (sorted[j]->partial == sorted[j - 1]->partial) {
+                        sorted[j]->candidate = true;
+                        sorted[j - 1]->candidate = true;
+                    }
+                }
+                free(sorted);
+            }
+            for (int j = 0; j < group->numFiles; j++) {
+                stats->partialCandidates += group->files[j]->candidate;
             }
         }
-        free(fullPath);
     }
-    closedir(dir);
 }
 
-void defaultPrint(SetCollection *sc, optionList *optList) {
-    int totalFiles = 0;
-    size_t totalSize = 0;
-    int totalUniqueFiles = 0;
-    size_t totalUniqueSize = 0;
+// hash files with ops on the worker threads, setting each one's hash and hashed
+static void hashFiles(fileInfo **files, int numFiles, const digestOps *ops, readConfig *config, int numJobs) {
+    hashWork job = {ops, files, NULL, NULL, NULL, 0, numFiles, config};
+    // both pull files off a shared counter several at a time per thread, the io_uring pipeline wins over lanes
+    bool useUring = config->strategy == READ_URING;
+    if (useUring || (ops == &sha256Ops && getSha256Kernel() == SHA256_AVX2)) {
+        workQueue *queues;
+        int numQueues = buildDeviceQueues(files, numFiles, numJobs, &queues);
+        job.paths = malloc((numFiles + 1) * sizeof(char *));
+        CHECK_ALLOC(job.paths);
+        job.digests = malloc((numFiles + 1) * sizeof(sha2Digest));
+        CHECK_ALLOC(job.digests);
+        job.hashed = calloc(numFiles + 1, sizeof(bool));
+        CHECK_ALLOC(job.hashed);
+        // each device's files are laid out together, so every device gets a counter of its own to pull from
+        int *order = malloc((numFiles + 1) * sizeof(int));
+        CHECK_ALLOC(order);
+        int numOrdered = 0;
+        for (int q = 0; q < numQueues; q++) {
+            memcpy(&order[numOrdered], queues[q].items, queues[q].numItems * sizeof(int));
+            numOrdered += queues[q].numItems;
+        }
+        // the paths are rebuilt for this batch only, into one buffer
+        size_t pathBytes = 0;
+        for (int i = 0; i < numFiles; i++) {
+            pathBytes += filePathLength(files[i]) + 1;
+        }
+        char *pathBuf = malloc(pathBytes + 1);
+        CHECK_ALLOC(pathBuf);
+        size_t pos = 0;
+        for (int i = 0; i < numFiles; i++) {
+            job.paths[i] = pathBuf + pos;
+            buildFilePath(files[order[i]], job.paths[i], pathBytes - pos);
+            pos += filePathLength(files[order[i]]) + 1;
+        }
+        // a device gets as many pullers as it may have threads, and they are what its queue hands out
+        hashWork *deviceJobs = malloc((numQueues + 1) * sizeof(hashWork));
+        CHECK_ALLOC(deviceJobs);
+        hashWork **pullers = malloc((numQueues * numJobs + 1) * sizeof(hashWork *));
+        CHECK_ALLOC(pullers);
+        int *pullerItems = malloc((numQueues * numJobs + 1) * sizeof(int));
+        CHECK_ALLOC(pullerItems);
+        int numPullers = 0, start = 0;
+        for (int q = 0; q < numQueues; q++) {
+            deviceJobs[q] = (hashWork){ops, NULL, job.paths + start, job.digests + start, job.hashed + start, 0, queues[q].numItems, config};
+            start += queues[q].numItems;
+            int numDevicePullers = queues[q].limit < queues[q].numItems ? queues[q].limit : queues[q].numItems;
+            free(queues[q].items);
+            queues[q] = (workQueue){&pullerItems[numPullers], numDevicePullers, 0, numDevicePullers, 0};
+            for (int i = 0; i < numDevicePullers; i++) {
+                pullerItems[numPullers] = numPullers;
+                pullers[numPullers++] = &deviceJobs[q];
+            }
+        }
+        runQueuedWorkers(numJobs, useUring ? hashUringJob : hashLanesJob, pullers, queues, numQueues);
+        for (int i = 0; i < numFiles; i++) {
+            files[order[i]]->hash = job.digests[i];
+            files[order[i]]->hashed = job.hashed[i];
+        }
+        free(pathBuf);
+        free(job.paths);
+        free(job.digests);
+        free(job.hashed);
+        free(order);
+        free(deviceJobs);
+        free(pullers);
+        free(pullerItems);
+        free(queues);
+    } else {
+        runDeviceWorkers(numJobs, hashJob, &job, files, numFiles);
+    }
+}
+
+static int compareFastDigest(const void *a, const void *b) {
+    fileInfo *fa = *(fileInfo **)a;
+    fileInfo *fb = *(fileInfo **)b;
+    if (fa->size != fb->size) {
+        return fa->size < fb->size ? -1 : 1;
+    }
+    return memcmp(&inodeOwner(fa)->hash, &inodeOwner(fb)->hash, sizeof(sha2Digest));
+}
+
+static int compareSize(const void *a, const void *b) {
+    size_t sa = *(size_t *)a;
+    size_t sb = *(size_t *)b;
+    return (sa > sb) - (sa < sb);
+}
+
+// Batch struct, size groups hashed together: every group at once, or a few at a time with --stream (groups, numGroups, files, numFiles)
+typedef struct hashBatch {
+    sizeGroup **groups;     // only groups of two or more files
+    int numGroups;
+    fileInfo **files;       // every file of the groups, in traversal order
+    int numFiles;
+} hashBatch;
+
+// fast mode: XXH3-128 every file in work, drop the ones whose size and fast digest no other candidate shares, and return how many are left for SHA-256
+static int filterFastDigests(hashBatch *batch, fileInfo **work, int numWork, readConfig *config, int numJobs, stageStats *stats) {
+    // every candidate whose inode still needs hashing, hard links included so an inode with two names stays a candidate
+    fileInfo **files = malloc((batch->numFiles + 1) * sizeof(fileInfo *));
+    CHECK_ALLOC(files);
+    // sizes with a cached SHA-256 digest, nothing of that size can be ruled out by fast digests alone
+    size_t *cachedSizes = malloc((batch->numFiles + 1) * sizeof(size_t));
+    CHECK_ALLOC(cachedSizes);
+    int numFiles = 0, numCached = 0;
+    for (int i = 0; i < batch->numFiles; i++) {
+        fileInfo *file = batch->files[i];
+        if (!file->candidate || file->size == 0 || file->compared != 0) {
+            continue;
+        }
+        if (inodeOwner(file)->hashed) {
+            cachedSizes[numCached++] = file->size;
+        } else {
+            files[numFiles++] = file;
+        }
+    }
+    qsort(cachedSizes, numCached, sizeof(size_t), compareSize);
+
+    hashFiles(work, numWork, &xxh128Ops, config, numJobs);
+    stats->fastHashed += numWork;
+
+    qsort(files, numFiles, sizeof(fileInfo *), compareFastDigest);
+    for (int i = 0; i < numFiles; i++) {
+        bool sharedBefore = i > 0 && compareFastDigest(&files[i - 1], &files[i]) == 0;
+        bool sharedAfter = i + 1 < numFiles && compareFastDigest(&files[i], &files[i + 1]) == 0;
+        // an unreadable file stays a candidate, so the SHA-256 pass reports it
+        if (sharedBefore || sharedAfter || !inodeOwner(files[i])->hashed
+            || bsearch(&files[i]->size, cachedSizes, numCached, sizeof(size_t), compareSize) != NULL) {
+            continue;
+        }
+        files[i]->candidate = false;
+        stats->fastCandidates--;
+    }
+    free(files);
+    free(cachedSizes);
+
+    // the fast digests are only for this filter, the survivors get SHA-256 and the rest no digest at all
+    int numLeft = 0;
+    for (int i = 0; i < numWork; i++) {
+        work[i]->hashed = false;
+        if (work[i]->candidate) {
+            work[numLeft++] = work[i];
+        }
+    }
+    return numLeft;
+}
+
+// Job struct for the byte comparison workers, one size group's candidate inodes (files, classOf, numFiles, config)
+typedef struct compareWork {
+    fileInfo *files[COMPARE_MAX_FILES];
+    int classOf[COMPARE_MAX_FILES];
+    int numFiles;
+    readConfig *config;
+} compareWork;
+
+// worker job: compare the inodes of one size group in lockstep
+static void compareJob(void *arg, int item) {
+    compareWork *work = &((compareWork *)arg)[item];
+    char pathBufs[COMPARE_MAX_FILES][PATH_MAX];
+    char *paths[COMPARE_MAX_FILES];
+    for (int i = 0; i < work->numFiles; i++) {
+        // an empty path fails to open like a path too long for PATH_MAX would
+        paths[i] = pathBufs[i];
+        if (!buildFilePath(work->files[i], paths[i], PATH_MAX)) {
+            paths[i][0] = '\0';
+        }
+    }
+    compareFiles(paths, work->numFiles, work->config, work->classOf);
+}
+
+// collect the candidate inodes of a size group if it is small enough to compare and not every one of them is in the cache, returns how many (0 to hash the group instead)
+static int compareCandidates(sizeGroup *group, digestCache *cache, fileInfo **files) {
+    if (group->size == 0 || group->numFiles < 2) {
+        return 0;
+    }
+    int numFiles = 0, numCached = 0;
+    for (int i = 0; i < group->numFiles; i++) {
+        fileInfo *file = group->files[i];
+        if (!file->candidate || file->primary != NULL) {
+            continue;
+        }
+        if (numFiles == COMPARE_MAX_FILES) {
+            return 0;
+        }
+        sha2Digest digest;
+        numCached += cache != NULL && lookupDigestCache(cache, file, &digest);
+        files[numFiles++] = file;
+    }
+    return numFiles >= 2 && numCached < numFiles ? numFiles : 0;
+}
+
+// -b: compare the candidates of each small size group byte by byte, and gather every name of each class of identical inodes into a set of its own, returns the sets by class (NULL for a class of one name)
+static Set **compareSizeGroups(hashBatch *batch, digestCache *cache, readConfig *config, int numJobs, stageStats *stats) {
+    fileInfo *files[COMPARE_MAX_FILES];
+    int numWork = 0;
+    for (int i = 0; i < batch->numGroups; i++) {
+        numWork += compareCandidates(batch->groups[i], cache, files) > 0;
+    }
+    compareWork *work = malloc((numWork + 1) * sizeof(compareWork));
+    CHECK_ALLOC(work);
+    numWork = 0;
+    for (int i = 0; i < batch->numGroups; i++) {
+        int numFiles = compareCandidates(batch->groups[i], cache, work[numWork].files);
+        if (numFiles > 0) {
+            work[numWork].numFiles = numFiles;
+            work[numWork].config = config;
+            numWork++;
+        }
+    }
+    // a group is queued on the device of its first file, groups rarely span devices
+    fileInfo **firstFiles = malloc((numWork + 1) * sizeof(fileInfo *));
+    CHECK_ALLOC(firstFiles);
+    for (int i = 0; i < numWork; i++) {
+        firstFiles[i] = work[i].files[0];
+    }
+    runDeviceWorkers(numJobs, compareJob, work, firstFiles, numWork);
+    free(firstFiles);
+
+    // number the classes, an unreadable inode is left to the full hash which reports the error
+    int numClasses = 0;
+    for (int i = 0; i < numWork; i++) {
+        int classIds[COMPARE_MAX_FILES];
+        for (int j = 0; j < work[i].numFiles; j++) {
+            int first = work[i].classOf[j];
+            if (first == j) {
+                classIds[j] = ++numClasses;
+            }
+            work[i].files[j]->compared = first >= 0 ? classIds[first] : 0;
+        }
+        stats->compared += work[i].numFiles;
+    }
+    free(work);
+
+    // names join their inode's class in traversal order, so each set lists its files as hashing would
+    Set **classes = calloc(numClasses + 1, sizeof(Set *));
+    CHECK_ALLOC(classes);
+    for (int i = 0; i < batch->numFiles; i++) {
+        fileInfo *file = batch->files[i];
+        if (!file->candidate || inodeOwner(file)->compared == 0) {
+            continue;
+        }
+        file->compared = inodeOwner(file)->compared;
+        Set **set = &classes[file->compared - 1];
+        if (*set == NULL) {
+            *set = initSet();
+        }
+        appendSetFile(*set, file);
+    }
+    // a class of one name has no duplicate, it goes back to being a file of unique contents
+    for (int i = 0; i < numClasses; i++) {
+        if (classes[i]->numFiles == 1) {
+            fileInfo *file = classes[i]->files[0];
+            file->compared = 0;
+            file->candidate = false;
+            stats->comparedUnique++;
+            freeSet(classes[i]);
+            classes[i] = NULL;
+        }
+    }
+    return classes;
+}
+
+// Hashing settings shared by every batch (ops, emptyDigest, cache, config, numJobs, compare)
+typedef struct hashPlan {
+    const digestOps *ops;
+    sha2Digest emptyDigest;
+    digestCache *cache;     // NULL without -c
+    readConfig config;
+    int numJobs;
+    bool compare;   // -b, but -d looks sets up by digest so nothing can be settled by comparison alone
+} hashPlan;
+
+static void initHashPlan(hashPlan *plan, optionList *optList) {
+    plan->compare = getOption(optList, 'b') != NULL && getOption(optList, 'd') == NULL;
+    plan->ops = getDigestOps(getHashAlgo());
+    plan->numJobs = getNumJobs(optList);
+    plan->config = getReadConfig(optList);
+    unsigned char emptyCtx[DIGEST_CONTEXT_MAX] __attribute__((aligned(64)));
+    plan->ops->init(emptyCtx);
+    plan->ops->finish(emptyCtx, &plan->emptyDigest);
+    _option *optc = getOption(optList, 'c');
+    plan->cache = optc != NULL ? openDigestCache(optc->args[optc->numArgs - 1], plan->ops->name) : NULL;
+}
+
+// save the digests hashed in every batch to the cache and close it
+static void finishHashPlan(hashPlan *plan) {
+    if (plan->cache != NULL) {
+        saveDigestCache(plan->cache);
+        freeDigestCache(plan->cache);
+    }
+}
+
+// hash (or compare) the candidates of a batch and add its files to sc, files without a possible duplicate only if withUnique
+static void hashBatchFiles(hashPlan *plan, hashBatch *batch, SetCollection *sc, stageStats *stats, bool withUnique) {
+    phaseClock clock;
+    startPhaseClock(&clock);
+    Set **classes = plan->compare ? compareSizeGroups(batch, plan->cache, &plan->config, plan->numJobs, stats) : NULL;
+
+    // hash every file that needs it on the worker threads first
+    fileInfo **work = malloc((batch->numFiles + 1) * sizeof(fileInfo *));   // +1 so an empty batch still allocates
+    CHECK_ALLOC(work);
+    int numWork = 0;
+    for (int i = 0; i < batch->numFiles; i++) {
+        fileInfo *file = batch->files[i];
+        if (!file->candidate || file->compared != 0) {
+            continue;
+        }
+        // another name of an inode that is already being hashed takes its primary's digest below
+        if (file->primary != NULL) {
+            stats->linksShared++;
+            continue;
+        }
+        // all empty files have the same hash, no need to open them
+        if (file->size == 0) {
+            file->hash = plan->emptyDigest;
+            file->hashed = true;
+        } else if (plan->cache != NULL && lookupDigestCache(plan->cache, file, &file->hash)) {
+            file->hashed = true;
+            stats->cacheHits++;
+        } else {
+            work[numWork++] = file;
+        }
+    }
+    if (getHashAlgo() == HASH_FAST) {
+        numWork = filterFastDigests(batch, work, numWork, &plan->config, plan->numJobs, stats);
+    }
+    hashFiles(work, numWork, plan->ops, &plan->config, plan->numJobs);
+    stats->fullHashed += numWork;
+    free(work);
+    for (int i = 0; i < batch->numFiles; i++) {
+        fileInfo *file = batch->files[i];
+        if (file->primary != NULL && file->candidate && file->compared == 0) {
+            file->hash = file->primary->hash;
+            file->hashed = file->primary->hashed;
+        }
+    }
+
+    if (plan->cache != NULL) {
+        for (int i = 0; i < batch->numFiles; i++) {
+            if (batch->files[i]->hashed && batch->files[i]->size > 0 && batch->files[i]->primary == NULL) {
+                addDigestCache(plan->cache, batch->files[i]);
+            }
+        }
+    }
+    stopPhaseClock(&clock, &stats->phases[PHASE_HASH]);
+
+    startPhaseClock(&clock);
+    // then merge serially in traversal order so sets are numbered the same whatever the thread count
+    for (int i = 0; i < batch->numFiles; i++) {
+        fileInfo *file = batch->files[i];
+        // the first name of a byte compared class in traversal order brings in the rest of its set
+        if (file->compared != 0) {
+            if (classes[file->compared - 1]->files[0] == file) {
+                pushSet(sc, classes[file->compared - 1]);
+            }
+            continue;
+        }
+        if (!file->candidate) {
+            if (withUnique) {
+                addFileSet(sc, file);
+            }
+            continue;
+        }
+        if (!file->hashed) {
+            char *path = filePath(file);
+            fprintf(stderr, "Error: Cannot add file %s to set collection\n", path);
+            free(path);
+            continue;
+        }
+        addFileSet(sc, file);
+    }
+    // the sets themselves now belong to the collection
+    free(classes);
+    stopPhaseClock(&clock, &stats->phases[PHASE_GROUP]);
+}
+
+void hashSizeGroups(sizeTable *st, SetCollection *sc, optionList *optList, stageStats *stats) {
+    phaseClock clock;
+    startPhaseClock(&clock);
+    hashPlan plan;
+    initHashPlan(&plan, optList);
+    stats->fastCandidates = stats->partialCandidates;
+    hashBatch batch = {NULL, 0, st->files, st->numFiles};
+    batch.groups = malloc((st->numFiles / 2 + 1) * sizeof(sizeGroup *));
+    CHECK_ALLOC(batch.groups);
+    // a lone -f query leaves every other group out, so its sets are all that is searched afterwards
+    bool query = isFileQuery(optList);
+    for (int i = 0; i < st->size; i++) {
+        for (sizeGroup *group = st->buckets[i]; group != NULL; group = group->next) {
+            if (group->numFiles >= 2 && (!query || group->queried)) {
+                batch.groups[batch.numGroups++] = group;
+            }
+        }
+    }
+    if (query) {
+        batch.files = malloc((stats->queried + 1) * sizeof(fileInfo *));
+        CHECK_ALLOC(batch.files);
+        batch.numFiles = 0;
+        for (int i = 0; i < st->numFiles; i++) {
+            if (getSizeGroup(st, st->files[i]->size)->queried) {
+                batch.files[batch.numFiles++] = st->files[i];
+            }
+        }
+    }
+    stopPhaseClock(&clock, &stats->phases[PHASE_HASH]);
+
+    hashBatchFiles(&plan, &batch, sc, stats, true);
+    free(batch.groups);
+    if (query) {
+        free(batch.files);
+    }
+
+    startPhaseClock(&clock);
+    finishHashPlan(&plan);
+    stopPhaseClock(&clock, &stats->phases[PHASE_HASH]);
+}
+
+// add up two summaries of files that share no set
+static void addSummaryTotals(summaryTotals *totals, summaryTotals *more) {
+    totals->numFiles += more->numFiles;
+    totals->size += more->size;
+    totals->allocated += more->allocated;
+    totals->numUnique += more->numUnique;
+    totals->uniqueSize += more->uniqueSize;
+    totals->uniqueAllocated += more->uniqueAllocated;
+}
+
+// --stream only reads the groups with candidates, the files of every other group are counted as the sets of one file
+// they would have been and freed with the list of every scanned file
+static void releaseUniqueFiles(sizeTable *st, summaryTotals *totals) {
+    for (int i = 0; i < st->size; i++) {
+        for (sizeGroup *group = st->buckets[i]; group != NULL; group = group->next) {
+            bool anyCandidate = false;
+            for (int j = 0; j < group->numFiles && !anyCandidate; j++) {
+                anyCandidate = group->files[j]->candidate;
+            }
+            if (group->numFiles >= 2 && anyCandidate) {
+                continue;
+            }
+            // a hard link's primary has its size and so is in the same group, no kept file is left pointing at a freed one
+            for (int j = 0; j < group->numFiles; j++) {
+                fileInfo *file = group->files[j];
+                summaryTotals alone = {1, file->size, file->primary == NULL ? file->allocated : 0, 1, file->size, file->allocated};
+                addSummaryTotals(totals, &alone);
+                free(file);
+            }
+            free(group->files);
+            group->files = NULL;
+            group->numFiles = 0;
+            group->capacity = 0;
+        }
+    }
+    // the inode map still points at freed records, only its counts are read from here on
+    free(st->files);
+    st->files = NULL;
+    st->numFiles = 0;
+    st->capacity = 0;
+}
+
+// --stream: hash the pending batch, print its duplicate sets, add them to the totals and let go of them, of its size groups and of their files
+static void streamBatch(hashPlan *plan, hashBatch *batch, stageStats *stats, int *numPrinted, summaryTotals *totals) {
+    SetCollection *sc = initSetCollection();
+    hashBatchFiles(plan, batch, sc, stats, true);
+    phaseClock clock;
+    startPhaseClock(&clock);
     for (int i = 0; i < sc->numSets; i++) {
-        totalFiles += sc->sets[i]->numFiles;
-        totalUniqueFiles++;
-        totalUniqueSize += sc->sets[i]->files[0]->size;
+        if (sc->sets[i]->numFiles > 1) {
+            printDuplicateSet(sc->sets[i], ++*numPrinted);
+        }
+    }
+    // whoever reads the other end can act on these sets while the next batch is hashed
+    fflush(stdout);
+    summaryTotals batchTotals;
+    countSummary(sc, &batchTotals);
+    addSummaryTotals(totals, &batchTotals);
+    freeSetCollection(sc);
+    for (int i = 0; i < batch->numGroups; i++) {
+        for (int j = 0; j < batch->groups[i]->numFiles; j++) {
+            free(batch->groups[i]->files[j]);
+        }
+        free(batch->groups[i]->files);
+        batch->groups[i]->files = NULL;
+        batch->groups[i]->numFiles = 0;
+        batch->groups[i]->capacity = 0;
+    }
+    batch->numGroups = 0;
+    batch->numFiles = 0;
+    stopPhaseClock(&clock, &stats->phases[PHASE_REPORT]);
+}
 
-        ino_t *encounteredInodes = calloc(sc->sets[i]->numFiles, sizeof(ino_t));
-        CHECK_ALLOC(encounteredInodes);
-        int numEncounteredInodes = 0;
-        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
-            bool isEncountered = false;
-            for (int k = 0; k < numEncounteredInodes; k++) {
-                if (encounteredInodes[k] == sc->sets[i]->files[j]->inode) {
-                    isEncountered = true;
-                    break;
-                }
+void streamSizeGroups(sizeTable *st, optionList *optList, stageStats *stats) {
+    phaseClock clock;
+    startPhaseClock(&clock);
+    hashPlan plan;
+    initHashPlan(&plan, optList);
+    stats->fastCandidates = stats->partialCandidates;
+    hashBatch batch = {NULL, 0, NULL, 0};
+    // every group has at least two files, so a batch never holds more groups than this
+    batch.groups = malloc(STREAM_BATCH_FILES * sizeof(sizeGroup *));
+    CHECK_ALLOC(batch.groups);
+    int capacity = STREAM_BATCH_FILES;
+    batch.files = malloc(capacity * sizeof(fileInfo *));
+    CHECK_ALLOC(batch.files);
+    summaryTotals totals = {0};
+    releaseUniqueFiles(st, &totals);
+    stopPhaseClock(&clock, &stats->phases[PHASE_HASH]);
+
+    printf("ALL DUPLICATE FILES:\n\n");
+    int numPrinted = 0;
+    size_t batchBytes = 0;
+    for (int i = 0; i < st->size; i++) {
+        for (sizeGroup *group = st->buckets[i]; group != NULL; group = group->next) {
+            // only the groups with candidates are left
+            if (group->numFiles == 0) {
+                continue;
+            }
+            // a group is never split, so the biggest one bounds what a batch holds
+            if (batch.numFiles + group->numFiles > capacity) {
+                capacity = batch.numFiles + group->numFiles;
+                batch.files = realloc(batch.files, capacity * sizeof(fileInfo *));
+                CHECK_ALLOC(batch.files);
             }
-            if (!isEncountered) {
-                encounteredInodes[numEncounteredInodes] = sc->sets[i]->files[j]->inode;
-                numEncounteredInodes++;
+            memcpy(&batch.files[batch.numFiles], group->files, group->numFiles * sizeof(fileInfo *));
+            batch.numFiles += group->numFiles;
+            batch.groups[batch.numGroups++] = group;
+            batchBytes += group->size * group->numFiles;
+            if (batch.numFiles >= STREAM_BATCH_FILES || batchBytes >= STREAM_BATCH_BYTES) {
+                streamBatch(&plan, &batch, stats, &numPrinted, &totals);
+                batchBytes = 0;
             }
         }
-        free(encounteredInodes);
-        totalSize += sc->sets[i]->files[0]->size * numEncounteredInodes;
     }
-    
-    if (getOption(optList, 'q') == NULL) {
-        printf("Total files found: %d\n", totalFiles);
-        printf("Total size of all files found: %zu bytes ~ %zu KB ~ %zu MB\n", totalSize, totalSize / 1024, totalSize / 1024 / 1024);
-        printf("Total unique files found: %d\n", totalUniqueFiles);
-        printf("Total size of unique files found: %zu bytes ~ %zu KB ~ %zu MB\n", totalUniqueSize, totalUniqueSize / 1024, totalUniqueSize / 1024 / 1024);
-        totalSize > totalUniqueSize ? printf("Potential space savings: %zu bytes ~ %zu KB ~ %zu MB (%.2f%%)\n", totalSize - totalUniqueSize, (totalSize - totalUniqueSize) / 1024, (totalSize - totalUniqueSize) / 1024 / 1024, (double)(totalSize - totalUniqueSize) / totalSize * 100) : printf("No potential space savings\n");
+    if (batch.numGroups > 0) {
+        streamBatch(&plan, &batch, stats, &numPrinted, &totals);
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+    printSummary(&totals, getOption(optList, 'q') != NULL);
+    free(batch.groups);
+    free(batch.files);
+
+    startPhaseClock(&clock);
+    finishHashPlan(&plan);
+    stopPhaseClock(&clock, &stats->phases[PHASE_HASH]);
+}
+
+bool parseStatsFormat(char *str, bool *json) {
+    if (str == NULL || strcmp(str, "text") == 0) {
+        *json = false;
+    } else if (strcmp(str, "json") == 0) {
+        *json = true;
     } else {
-        if (totalSize > totalUniqueSize) {
-            printf("Duplicate files found. Can save %zu bytes ~ %zu KB ~ %zu MB (%.2f%% potential space savings) [redundant files: %d] [unique files: %d, total files: %d]\n", totalSize - totalUniqueSize, (totalSize - totalUniqueSize) / 1024, (totalSize - totalUniqueSize) / 1024 / 1024, (double)(totalSize - totalUniqueSize) / totalSize * 100, totalFiles - totalUniqueFiles, totalUniqueFiles, totalFiles);
+        return false;
+    }
+    return true;
+}
+
+void printStageStats(stageStats *stats, sizeTable *st, SetCollection *sc, optionList *optList) {
+    _option *opts = getOption(optList, 's');
+    bool json = false;
+    parseStatsFormat(opts->numArgs > 0 ? opts->args[opts->numArgs - 1] : NULL, &json);
+    ioCounters io;
+    getIoCounters(&io);
+    readConfig config = getReadConfig(optList);
+    double setLoad = (double)sc->numIndexed / sc->numSlots;
+    double inodeLoad = (double)st->inodes->numInodes / st->inodes->numSlots;
+
+    if (json) {
+        // one line, so it can be picked out of stderr
+        fprintf(stderr, "{\"phases\": {");
+        for (int i = 0; i < NUM_PHASES; i++) {
+            fprintf(stderr, "%s\"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f}", i > 0 ? ", " : "", phaseName(i), stats->phases[i].wall, stats->phases[i].cpu);
+        }
+        fprintf(stderr, "}, \"io\": {\"directories\": %lu, \"entries\": %lu, \"stat_calls\": %lu, \"files_opened\": %lu, \"bytes_read\": %lu, \"hole_bytes\": %lu}",
+                io.directories, io.entries, io.statCalls, io.filesOpened, io.bytesRead, io.holeBytes);
+        fprintf(stderr, ", \"filters\": {\"scanned\": %d, \"queried\": %d, \"skipped_by_query\": %d, \"size_candidates\": %d, \"skipped_by_size\": %d, \"partial_fingerprinted\": %d, \"partial_candidates\": %d, \"skipped_by_partial\": %d, "
+                "\"byte_compared\": %d, \"unique_by_compare\": %d, \"fast_hashed\": %d, \"fast_candidates\": %d, \"skipped_by_fast_hash\": %d, \"full_hashed\": %d, \"cache_hits\": %d, \"links_shared\": %d}",
+                stats->scanned, stats->queried, stats->scanned - stats->queried, stats->sizeCandidates, stats->queried - stats->sizeCandidates, stats->partialFingerprinted, stats->partialCandidates,
+                stats->sizeCandidates - stats->partialCandidates, stats->compared, stats->comparedUnique, stats->fastHashed, stats->fastCandidates, stats->partialCandidates - stats->fastCandidates,
+                stats->fullHashed, stats->cacheHits, stats->linksShared);
+        fprintf(stderr, ", \"index\": {\"sets\": %d, \"indexed_sets\": %d, \"slots\": %d, \"load_factor\": %.4f, \"inodes\": %d, \"inode_slots\": %d, \"inode_load_factor\": %.4f}",
+                sc->numSets, sc->numIndexed, sc->numSlots, setLoad, st->inodes->numInodes, st->inodes->numSlots, inodeLoad);
+        fprintf(stderr, ", \"devices\": {\"queues\": %d, \"rotational\": %d}", stats->numDevices, stats->rotationalDevices);
+        fprintf(stderr, ", \"read\": {\"strategy\": \"%s\", \"buffer_bytes\": %zu, \"drop_cache\": %s}, \"hash_algo\": \"%s\", \"sha_kernel\": \"%s\", \"peak_rss_kb\": %ld}\n",
+                readStrategyName(config.strategy), config.bufferSize, config.dropCache ? "true" : "false", hashAlgoName(getHashAlgo()), sha256KernelName(getSha256Kernel()), peakRssKb());
+        return;
+    }
+
+    fprintf(stderr, "Files scanned: %d\n", stats->scanned);
+    if (stats->queried < stats->scanned) {
+        fprintf(stderr, "Files in size groups of the -f names: %d\n", stats->queried);
+    }
+    fprintf(stderr, "Candidates after size grouping: %d\n", stats->sizeCandidates);
+    fprintf(stderr, "Candidates after partial fingerprint: %d (%d fingerprinted)\n", stats->partialCandidates, stats->partialFingerprinted);
+    if (getOption(optList, 'b') != NULL) {
+        fprintf(stderr, "Files compared byte by byte: %d (%d found unique)\n", stats->compared, stats->comparedUnique);
+    }
+    if (getHashAlgo() == HASH_FAST) {
+        fprintf(stderr, "Candidates after fast hash: %d (%d fast hashed)\n", stats->fastCandidates, stats->fastHashed);
+    }
+    fprintf(stderr, "Files fully hashed: %d\n", stats->fullHashed);
+    fprintf(stderr, "Digests reused from cache: %d\n", stats->cacheHits);
+    fprintf(stderr, "Hard links sharing a digest: %d\n", stats->linksShared);
+    for (int i = 0; i < NUM_PHASES; i++) {
+        fprintf(stderr, "Phase %s: %.3fs wall, %.3fs CPU\n", phaseName(i), stats->phases[i].wall, stats->phases[i].cpu);
+    }
+    fprintf(stderr, "Directories read: %lu, entries: %lu, stat calls: %lu\n", io.directories, io.entries, io.statCalls);
+    fprintf(stderr, "Files opened: %lu, bytes read: %lu, sparse holes hashed without reading: %lu bytes\n", io.filesOpened, io.bytesRead, io.holeBytes);
+    fprintf(stderr, "Digest index: %d sets in %d slots (load %.2f), inode map: %d inodes in %d slots (load %.2f)\n",
+            sc->numIndexed, sc->numSlots, setLoad, st->inodes->numInodes, st->inodes->numSlots, inodeLoad);
+    printReadConfig(&config);
+    fprintf(stderr, "Device queues: %d (%d rotational, read by %d thread%s each)\n", stats->numDevices, stats->rotationalDevices, ROTATIONAL_DEVICE_JOBS, ROTATIONAL_DEVICE_JOBS == 1 ? "" : "s");
+    fprintf(stderr, "Hash algorithm: %s\n", hashAlgoName(getHashAlgo()));
+    fprintf(stderr, "SHA-256 kernel: %s\n", sha256KernelName(getSha256Kernel()));
+    fprintf(stderr, "Peak RSS: %ld KB\n", peakRssKb());
+}
+
+void printSummary(summaryTotals *t, bool quiet) {
+    // the first file of each set is the one kept, so its blocks are what stays allocated
+    size_t savedAllocated = t->allocated - t->uniqueAllocated;
+    if (!quiet) {
+        printf("Total files found: %d\n", t->numFiles);
+        printf("Total size of all files found: %zu bytes ~ %zu KB ~ %zu MB (allocated: %zu bytes ~ %zu MB)\n", t->size, t->size / 1024, t->size / 1024 / 1024, t->allocated, t->allocated / 1024 / 1024);
+        printf("Total unique files found: %d\n", t->numUnique);
+        printf("Total size of unique files found: %zu bytes ~ %zu KB ~ %zu MB (allocated: %zu bytes ~ %zu MB)\n", t->uniqueSize, t->uniqueSize / 1024, t->uniqueSize / 1024 / 1024, t->uniqueAllocated, t->uniqueAllocated / 1024 / 1024);
+        t->size > t->uniqueSize ? printf("Potential space savings: %zu bytes ~ %zu KB ~ %zu MB (%.2f%%) (allocated: %zu bytes ~ %zu MB)\n", t->size - t->uniqueSize, (t->size - t->uniqueSize) / 1024, (t->size - t->uniqueSize) / 1024 / 1024, (double)(t->size - t->uniqueSize) / t->size * 100, savedAllocated, savedAllocated / 1024 / 1024) : printf("No potential space savings\n");
+    } else {
+        if (t->size > t->uniqueSize) {
+            printf("Duplicate files found. Can save %zu bytes ~ %zu KB ~ %zu MB (%.2f%% potential space savings, %zu bytes allocated) [redundant files: %d] [unique files: %d, total files: %d]\n", t->size - t->uniqueSize, (t->size - t->uniqueSize) / 1024, (t->size - t->uniqueSize) / 1024 / 1024, (double)(t->size - t->uniqueSize) / t->size * 100, savedAllocated, t->numFiles - t->numUnique, t->numUnique, t->numFiles);
         } else {
-            if (totalFiles > totalUniqueFiles) {
-                printf("No duplicate files found. %d files are hard linked. [unique files: %d, total files: %d]\n", totalFiles - totalUniqueFiles, totalUniqueFiles, totalFiles);
+            if (t->numFiles > t->numUnique) {
+                printf("No duplicate files found. %d files are hard linked. [unique files: %d, total files: %d]\n", t->numFiles - t->numUnique, t->numUnique, t->numFiles);
             } else {
-                printf("No duplicate files found. [unique files: %d, total files: %d]\n", totalUniqueFiles, totalFiles);
+                printf("No duplicate files found. [unique files: %d, total files: %d]\n", t->numUnique, t->numFiles);
+            }
+        }
+    }
+}
+
+void countSummary(SetCollection *sc, summaryTotals *totals) {
+    *totals = (summaryTotals){0};
+    for (int i = 0; i < sc->numSets; i++) {
+        // --watch leaves a set in place when its last file goes, so the others keep their numbers
+        if (sc->sets[i]->numFiles == 0) {
+            continue;
+        }
+        totals->numFiles += sc->sets[i]->numFiles;
+        totals->numUnique++;
+        totals->uniqueSize += sc->sets[i]->files[0]->size;
+        totals->size += sc->sets[i]->files[0]->size * sc->sets[i]->numInodes;
+        totals->uniqueAllocated += sc->sets[i]->files[0]->allocated;
+        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
+            if (inodeOwner(sc->sets[i]->files[j]) == sc->sets[i]->files[j]) {
+                totals->allocated += sc->sets[i]->files[j]->allocated;
             }
         }
     }
 }
 
-void listDuplicatesWithHash(char *hash, hashTable *ht) {
-    unsigned long index = hash_function(hash) % ht->size;
-    fileInfo *current = ht->buckets[index]->head;
-    if (current == NULL) {
+void defaultPrint(SetCollection *sc, optionList *optList) {
+    summaryTotals totals;
+    countSummary(sc, &totals);
+    printSummary(&totals, getOption(optList, 'q') != NULL);
+}
+
+// one line of a duplicate listing, the path is only put back together to be printed
+static void printFileLine(fileInfo *file) {
+    char *path = filePath(file);
+    printf("%s\t[inode: %lu, size: %zu bytes ~ %zu KB ~ %zu MB]\n", path, file->inode, file->size, file->size / 1024, file->size / 1024 / 1024);
+    free(path);
+}
+
+void listDuplicatesWithHash(char *hash, SetCollection *sc) {
+    // parse once, the lookup below is on the binary digest
+    sha2Digest target;
+    printDuplicatesWithHash(hash, parseDigest(hash, &target) ? findSet(sc, &target) : NULL);
+}
+
+void printDuplicatesWithHash(char *hash, Set *set) {
+    // only files that share their size and fingerprint are hashed, so a digest alone in its set means no duplicates
+    if (set == NULL || set->numFiles <= 1) {
         printf("No duplicate files with hash %s found\n", hash);
         return;
-    } else{
-        printf("DUPLICATE FILES WITH HASH %s:\n\n", hash);
-        while (current != NULL) {
-            if (strcmp(current->hash, hash) == 0) {
-                printf("%s\t[inode: %lu, size: %zu bytes ~ %zu KB ~ %zu MB]\n", current->path, current->inode, current->size, current->size / 1024, current->size / 1024 / 1024);
-                printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-            }
-            current = current->next;
-        }   
-        printf("-------------------------------------------------------------------------------------\n");
     }
+    printf("DUPLICATE FILES WITH HASH %s:\n\n", hash);
+    for (int i = 0; i < set->numFiles; i++) {
+        fileInfo *current = set->files[i];
+        printFileLine(current);
+        printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    }
+    printf("-------------------------------------------------------------------------------------\n");
 }
 
-void listDuplicatesToFileNamed(char *filename, SetCollection *sc, hashTable *ht) {
-    char *targetHash = NULL;
+void listDuplicatesToFileNamed(char *filename, SetCollection *sc) {
+    // the last set holding a file of that name is the one reported
+    Set *target = NULL;
     for (int i = 0; i < sc->numSets; i++) {
         for (int j = 0; j < sc->sets[i]->numFiles; j++) {
             if (strcmp(sc->sets[i]->files[j]->filename, filename) == 0) {
-                targetHash = sc->sets[i]->hash;
+                target = sc->sets[i];
                 break;
             }
         }
     }
-    if (targetHash != NULL) {
-        unsigned long index = hash_function(targetHash) % ht->size;
-        fileInfo *current = ht->buckets[index]->head;
-        if (current == NULL || current->next == NULL) {
-            printf("No duplicate files to %s found\n", filename);
-            return;
-        } else {
-            printf("DUPLICATE FILES TO %s:\n\n", filename);
-            while (current != NULL) {
-                if (strcmp(current->hash, targetHash) == 0 && strcmp(current->filename, filename) != 0) {
-                    printf("%s\t[inode: %lu, size: %zu bytes ~ %zu KB ~ %zu MB]\n", current->path, current->inode, current->size, current->size / 1024, current->size / 1024 / 1024);
-                    printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-                }
-                current = current->next;
-            }
-            printf("-------------------------------------------------------------------------------------\n");
-        }
-    } else {
+    printDuplicatesToFileNamed(filename, target);
+}
+
+void printDuplicatesToFileNamed(char *filename, Set *target) {
+    if (target == NULL) {
         printf("No file named %s found\n", filename);
         return;
     }
+    // a file that was never hashed or compared has a unique size or fingerprint, so it is alone in its set
+    if (target->numFiles == 1) {
+        printf("No duplicate files to %s found\n", filename);
+        return;
+    }
+    printf("DUPLICATE FILES TO %s:\n\n", filename);
+    for (int i = 0; i < target->numFiles; i++) {
+        fileInfo *current = target->files[i];
+        if (strcmp(current->filename, filename) != 0) {
+            printFileLine(current);
+            printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+}
+
+void printDuplicateSet(Set *set, int number) {
+    char hex[SHA2_DIGEST_LEN_STR + 1] = "compared byte by byte";
+    if (set->hash != NULL) {
+        formatDigest(set->hash, hex);
+    }
+    printf("Set %d (%d) [%s]:", number, set->numFiles, hex);
+    set->numInodes == 1 ? printf(" all files are hard linked\n") : printf(" %d/%d files are hard linked\n", set->numFiles - set->numInodes + 1, set->numFiles);
+    printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    for (int j = 0; j < set->numFiles; j++) {
+        printFileLine(set->files[j]);
+    }
+    printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
+    printf("\n");
 }
 
 void listAllDuplicates(SetCollection *sc) {
     printf("ALL DUPLICATE FILES:\n\n");
     for (int i = 0; i < sc->numSets; i++) {
-
-        ino_t *encounteredInodes = calloc(sc->sets[i]->numFiles, sizeof(ino_t));
-        CHECK_ALLOC(encounteredInodes);
-        int numEncounteredInodes = 0;
-        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
-            bool isEncountered = false;
-            for (int k = 0; k < numEncounteredInodes; k++) {
-                if (encounteredInodes[k] == sc->sets[i]->files[j]->inode) {
-                    isEncountered = true;
-                    break;
-                }
-            }
-            if (!isEncountered) {
-                encounteredInodes[numEncounteredInodes] = sc->sets[i]->files[j]->inode;
-                numEncounteredInodes++;
-            }
-        }
-        free(encounteredInodes);
-
         if (sc->sets[i]->numFiles > 1) {
-            printf("Set %d (%d) [%s]:", i + 1, sc->sets[i]->numFiles, sc->sets[i]->hash);
-            numEncounteredInodes == 1 ? printf(" all files are hard linked\n") : printf(" %d/%d files are hard linked\n", sc->sets[i]->numFiles - numEncounteredInodes + 1, sc->sets[i]->numFiles);
-            // printf("numEncounteredInodes: %d, numfiles: %d\n", numEncounteredInodes, sc->sets[i]->numFiles);
-            printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-            for (int j = 0; j < sc->sets[i]->numFiles; j++) {
-                printf("%s\t[inode: %lu, size: %zu bytes ~ %zu KB ~ %zu MB]\n", sc->sets[i]->files[j]->path, sc->sets[i]->files[j]->inode, sc->sets[i]->files[j]->size, sc->sets[i]->files[j]->size / 1024, sc->sets[i]->files[j]->size / 1024 / 1024);
-            }
-            printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
-            printf("\n");
+            printDuplicateSet(sc->sets[i], i + 1);
         }
     }
     printf("-------------------------------------------------------------------------------------\n");
 }
 
-void minimiseMemoryUsage(SetCollection *sc) {
-    size_t totalSize = 0;
-    size_t totalUniqueSize = 0;
-    int numLinks = 0;
+static int compareDupOwner(const void *a, const void *b) {
+    fileInfo *fa = inodeOwner((*(linkOp **)a)->dup);
+    fileInfo *fb = inodeOwner((*(linkOp **)b)->dup);
+    return (fa > fb) - (fa < fb);
+}
 
-    for (int i = 0; i < sc->numSets; i++) {     
-        totalUniqueSize += sc->sets[i]->files[0]->size;
+// bytes freed by the ops that went through, a duplicate inode only counts once every one of its names points elsewhere
+static size_t linkedBytes(linkOp *ops, int numOps) {
+    linkOp **byOwner = malloc((numOps + 1) * sizeof(linkOp *));
+    CHECK_ALLOC(byOwner);
+    for (int i = 0; i < numOps; i++) {
+        byOwner[i] = &ops[i];
+    }
+    qsort(byOwner, numOps, sizeof(linkOp *), compareDupOwner);
+    size_t freed = 0;
+    for (int i = 0, j; i < numOps; i = j) {
+        bool allLinked = true;
+        for (j = i; j < numOps && compareDupOwner(&byOwner[i], &byOwner[j]) == 0; j++) {
+            allLinked = allLinked && (byOwner[j]->result == LINK_DONE || byOwner[j]->result == LINK_PLANNED);
+        }
+        freed += allLinked ? byOwner[i]->dup->size : 0;
+    }
+    free(byOwner);
+    return freed;
+}
 
-        ino_t *encounteredInodes = calloc(sc->sets[i]->numFiles, sizeof(ino_t));
-        CHECK_ALLOC(encounteredInodes);
-        int numEncounteredInodes = 0;
-        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
-            bool isEncountered = false;
-            for (int k = 0; k < numEncounteredInodes; k++) {
-                if (encounteredInodes[k] == sc->sets[i]->files[j]->inode) {
-                    isEncountered = true;
-                    break;
-                }
-            }
-            if (!isEncountered) {
-                encounteredInodes[numEncounteredInodes] = sc->sets[i]->files[j]->inode;
-                numEncounteredInodes++;
-            }
+void minimiseMemoryUsage(SetCollection *sc, optionList *optList) {
+    bool dryRun = getOption(optList, 'n') != NULL;
+    size_t totalSize = 0;
+    int numOps = 0;
+    for (int i = 0; i < sc->numSets; i++) {
+        totalSize += sc->sets[i]->files[0]->size * sc->sets[i]->numInodes;
+        for (int j = 1; j < sc->sets[i]->numFiles; j++) {
+            numOps += inodeOwner(sc->sets[i]->files[j]) != inodeOwner(sc->sets[i]->files[0]);
         }
-        free(encounteredInodes);
-        totalSize += sc->sets[i]->files[0]->size * numEncounteredInodes;
+    }
 
-        if (sc->sets[i]->numFiles > 1) {
-            for (int j = 1; j < sc->sets[i]->numFiles; j++) {
-                if (sc->sets[i]->files[j]->inode != sc->sets[i]->files[0]->inode) {
-                    if (unlink(sc->sets[i]->files[j]->path) == -1) {
-                        fprintf(stderr, "Error: Cannot unlink file %s\n", sc->sets[i]->files[j]->path);
-                    } else {
-                        if (link(sc->sets[i]->files[0]->path, sc->sets[i]->files[j]->path) == -1) {
-                            fprintf(stderr, "Error: Cannot link file %s to %s\n", sc->sets[i]->files[0]->path, sc->sets[i]->files[j]->path);
-                        }
-                        numLinks++;                     
-                    }
-                } else {
-                    fprintf(stderr, "File %s is already hard linked to %s. (inode: %lu). Skipping...\n", sc->sets[i]->files[j]->path, sc->sets[i]->files[0]->path, sc->sets[i]->files[0]->inode);
-                }
+    // every name in a set is pointed at the set's first file, unless it already is
+    linkOp *ops = calloc(numOps + 1, sizeof(linkOp));
+    CHECK_ALLOC(ops);
+    numOps = 0;
+    for (int i = 0; i < sc->numSets; i++) {
+        fileInfo *original = sc->sets[i]->files[0];
+        for (int j = 1; j < sc->sets[i]->numFiles; j++) {
+            fileInfo *dup = sc->sets[i]->files[j];
+            if (inodeOwner(dup) != inodeOwner(original)) {
+                ops[numOps++] = (linkOp){original, dup, LINK_PLANNED, 0};
+            } else {
+                char *dupPath = filePath(dup), *originalPath = filePath(original);
+                fprintf(stderr, "File %s is already hard linked to %s. (inode: %lu). Skipping...\n", dupPath, originalPath, original->inode);
+                free(dupPath);
+                free(originalPath);
             }
         }
-    } 
-    if (numLinks == 0) {
+    }
+    if (numOps == 0) {
+        free(ops);
         printf("Space is already minimised\n");
         return;
     }
+    runLinkOps(ops, numOps, dryRun, getNumJobs(optList));
+
+    // report in set order, whichever thread got to each op
+    if (dryRun) {
+        printf("HARD LINK PLAN:\n\n");
+    }
+    int numLinks = 0;
+    for (int i = 0; i < numOps; i++) {
+        linkOp *op = &ops[i];
+        if (op->result == LINK_DONE) {
+            numLinks++;
+            continue;
+        }
+        char *dupPath = filePath(op->dup), *originalPath = filePath(op->original);
+        switch (op->result) {
+            case LINK_PLANNED:
+                printf("%s\t-> %s\n", dupPath, originalPath);
+                numLinks++;
+                break;
+            case LINK_CROSS_DEVICE:
+                fprintf(stderr, "Error: Cannot link file %s to %s, they are on different devices\n", originalPath, dupPath);
+                break;
+            case LINK_CHANGED:
+                fprintf(stderr, "Error: File %s or %s changed since it was scanned. Skipping...\n", originalPath, dupPath);
+                break;
+            case LINK_SYMLINK:
+                fprintf(stderr, "Error: File %s is a symbolic link, not replacing it with a hard link to %s. Skipping...\n", dupPath, originalPath);
+                break;
+            default:
+                fprintf(stderr, "Error: Cannot link file %s to %s: %s\n", originalPath, dupPath, strerror(op->error));
+                break;
+        }
+        free(dupPath);
+        free(originalPath);
+    }
+    size_t saved = linkedBytes(ops, numOps);
+    free(ops);
+    if (dryRun) {
+        printf("-------------------------------------------------------------------------------------\n");
+        printf("Files that would be hard linked: %d\n", numLinks);
+        printf("Space that would be saved: %zu bytes ~ %zu KB ~ %zu MB (%.2f%%)\n", saved, saved / 1024, saved / 1024 / 1024, totalSize > 0 ? (double)saved / totalSize * 100 : 0.0);
+        return;
+    }
     printf("Total files hard linked: %d\n", numLinks);
-    printf("Space saved: %zu bytes ~ %zu KB ~ %zu MB (%.2f%%)\n", totalSize - totalUniqueSize, (totalSize - totalUniqueSize) / 1024, (totalSize - totalUniqueSize) / 1024 / 1024, (double)(totalSize - totalUniqueSize) / totalSize * 100);
-}
\ No newline at end of file
+    printf("Space saved: %zu bytes ~ %zu KB ~ %zu MB (%.2f%%)\n", saved, saved / 1024, saved / 1024 / 1024, totalSize > 0 ? (double)saved / totalSize * 100 : 0.0);
+}
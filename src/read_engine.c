@@ -0,0 +1,319 @@
+#include "headers/read_engine.h"
+#include "headers/stats.h"
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+
+// where a SIGBUS on this thread jumps to while it reads mapped chunks, and the address that faulted
+static __thread sigjmp_buf *mapFaultJump;
+static __thread void *mapFaultAddress;
+static pthread_once_t mapFaultOnce = PTHREAD_ONCE_INIT;
+
+// a mapped file shrank while it was read, so the read that touched it gets an error, any other SIGBUS still kills the process
+static void mapFaultHandler(int sig, siginfo_t *info, void *context) {
+    (void)context;
+    if (mapFaultJump == NULL) {
+        // the access faults again on return, this time with the default action
+        signal(sig, SIG_DFL);
+        return;
+    }
+    mapFaultAddress = info->si_addr;
+    siglongjmp(*mapFaultJump, 1);
+}
+
+static void installMapFaultHandler() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = mapFaultHandler;
+    // left by a jump rather than a return, so it must not stay blocked
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, NULL);
+}
+
+
+readConfig defaultReadConfig() {
+    readConfig config = {READ_AUTO, READ_BUFFER_SIZE, MMAP_THRESHOLD, true};
+    return config;
+}
+
+bool parseByteSize(char *str, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str || errno != 0 || *str == '-') {
+        return false;
+    }
+    switch (*end) {
+        case 'G': case 'g':
+            value <<= 10;
+            // fall through
+        case 'M': case 'm':
+            value <<= 10;
+            // fall through
+        case 'K': case 'k':
+            value <<= 10;
+            end++;
+            break;
+        case '\0':
+            break;
+        default:
+            return false;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    *size = value;
+    return true;
+}
+
+char *readStrategyName(readStrategy strategy) {
+    switch (strategy) {
+        case READ_READ:
+            return "read";
+        case READ_MMAP:
+            return "mmap";
+        case READ_URING:
+            return "uring";
+        default:
+            return "auto";
+    }
+}
+
+bool parseReadStrategy(char *str, readStrategy *strategy) {
+    if (strcmp(str, "auto") == 0) {
+        *strategy = READ_AUTO;
+    } else if (strcmp(str, "read") == 0) {
+        *strategy = READ_READ;
+    } else if (strcmp(str, "mmap") == 0) {
+        *strategy = READ_MMAP;
+    } else if (strcmp(str, "uring") == 0) {
+        *strategy = READ_URING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printReadConfig(readConfig *config) {
+    fprintf(stderr, "Read strategy: %s", readStrategyName(config->strategy));
+    if (config->strategy == READ_AUTO) {
+        fprintf(stderr, " (mmap from %zu bytes)", config->mmapThreshold);
+    }
+    fprintf(stderr, ", buffer %zu bytes, %s page cache\n", config->bufferSize, config->dropCache ? "dropping" : "keeping");
+}
+
+bool isRotationalDevice(dev_t device) {
+    // a partition has no queue of its own, its disk's is one level up
+    char *formats[] = {"/sys/dev/block/%u:%u/queue/rotational", "/sys/dev/block/%u:%u/../queue/rotational"};
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        char path[64];
+        snprintf(path, sizeof(path), formats[i], major(device), minor(device));
+        FILE *f = fopen(path, "r");
+        if (f != NULL) {
+            int rotational = fgetc(f);
+            fclose(f);
+            return rotational == '1';
+        }
+    }
+    return false;
+}
+
+bool isSparse(struct stat *statBuf) {
+    return (size_t)statBuf->st_blocks * 512 < (size_t)statBuf->st_size;
+}
+
+void findDataExtent(int fd, size_t pos, size_t size, size_t *dataStart, size_t *dataEnd) {
+    off_t data = lseek(fd, pos, SEEK_DATA);
+    if (data == -1) {
+        // ENXIO means there is no data past pos, anything else that holes cannot be found here
+        *dataStart = errno == ENXIO ? size : pos;
+        *dataEnd = size;
+        return;
+    }
+    off_t hole = lseek(fd, data, SEEK_HOLE);
+    *dataStart = (size_t)data < size ? (size_t)data : size;
+    *dataEnd = hole != -1 && (size_t)hole < size ? (size_t)hole : size;
+}
+
+bool openReadStream(readStream *rs, char *filename, readConfig *config) {
+    memset(rs, 0, sizeof(readStream));
+    rs->config = config;
+#if defined(O_BINARY)
+    rs->fd = open(filename, O_RDONLY | O_BINARY);
+#else
+    rs->fd = open(filename, O_RDONLY);
+#endif
+    if (rs->fd < 0) {
+        return false;
+    }
+    COUNT_IO(filesOpened, 1);
+    COUNT_IO(statCalls, 1);
+    struct stat statBuf;
+    if (fstat(rs->fd, &statBuf) == -1) {
+        close(rs->fd);
+        return false;
+    }
+    rs->size = statBuf.st_size;
+    rs->sparse = isSparse(&statBuf);
+    posix_fadvise(rs->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // map big files, madvise lets the kernel read well ahead of us (sparse files are read around their holes instead)
+    if (rs->size > 0 && !rs->sparse && (config->strategy == READ_MMAP || (config->strategy == READ_AUTO && rs->size >= config->mmapThreshold))) {
+        rs->map = mmap(NULL, rs->size, PROT_READ, MAP_PRIVATE, rs->fd, 0);
+        if (rs->map != MAP_FAILED) {
+            pthread_once(&mapFaultOnce, installMapFaultHandler);
+            madvise(rs->map, rs->size, MADV_SEQUENTIAL);
+            return true;
+        }
+        rs->map = NULL;
+    }
+
+    // no point in a buffer bigger than the file (plus one page to see EOF in the same read)
+    rs->bufferSize = config->bufferSize;
+    if (rs->size + READ_BUFFER_MIN < rs->bufferSize) {
+        rs->bufferSize = (rs->size / READ_BUFFER_MIN + 1) * READ_BUFFER_MIN;
+    }
+    if (posix_memalign((void **)&rs->buf, READ_BUFFER_MIN, rs->bufferSize) != 0) {
+        perror(__func__);
+        exit(1);
+    }
+    return true;
+}
+
+// fill up to room bytes at pos of a sparse file, with zeros if pos is in a hole and with a read otherwise, adding the zeros to *zeroed (0 at end of file, -1 on error)
+static ssize_t readSparse(readStream *rs, unsigned char *dst, size_t room, size_t pos, size_t *zeroed) {
+    if (pos >= rs->size) {
+        return 0;
+    }
+    if (pos >= rs->dataEnd) {
+        findDataExtent(rs->fd, pos, rs->size, &rs->dataStart, &rs->dataEnd);
+    }
+    if (pos < rs->dataStart) {
+        size_t len = rs->dataStart - pos < room ? rs->dataStart - pos : room;
+        memset(dst, 0, len);
+        *zeroed += len;
+        return len;
+    }
+    size_t len = rs->dataEnd - pos < room ? rs->dataEnd - pos : room;
+    ssize_t got;
+    do {
+        got = pread(rs->fd, dst, len, pos);
+    } while (got < 0 && errno == EINTR);
+    return got;
+}
+
+ssize_t nextReadChunk(readStream *rs, unsigned char **chunk) {
+    if (rs->map != NULL) {
+        if (rs->offset >= rs->size) {
+            return 0;
+        }
+        size_t len = rs->size - rs->offset < rs->config->bufferSize ? rs->size - rs->offset : rs->config->bufferSize;
+        *chunk = rs->map + rs->offset;
+        rs->offset += len;
+        COUNT_IO(bytesRead, len);
+        return len;
+    }
+    // fill the whole buffer so only the last chunk can be short
+    size_t filled = 0, zeroed = 0;
+    while (filled < rs->bufferSize) {
+        if (rs->sparse) {
+            ssize_t got = readSparse(rs, rs->buf + filled, rs->bufferSize - filled, rs->offset + filled, &zeroed);
+            if (got == 0) {
+                break;
+            }
+            if (got < 0) {
+                return -1;
+            }
+            filled += got;
+            continue;
+        }
+        ssize_t got = read(rs->fd, rs->buf + filled, rs->bufferSize - filled);
+        if (got == 0) {
+            break;
+        }
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        filled += got;
+    }
+    *chunk = rs->buf;
+    rs->offset += filled;
+    COUNT_IO(bytesRead, filled - zeroed);
+    COUNT_IO(holeBytes, zeroed);
+    return filled;
+}
+
+bool guardMappedAccess(void (*access)(void *ctx), void *ctx, void **faultAddress) {
+    sigjmp_buf jump;
+    if (sigsetjmp(jump, 0) != 0) {
+        mapFaultJump = NULL;
+        *faultAddress = mapFaultAddress;
+        return false;
+    }
+    mapFaultJump = &jump;
+    access(ctx);
+    mapFaultJump = NULL;
+    return true;
+}
+
+bool streamMapHolds(readStream *rs, void *address) {
+    return rs->map != NULL && (unsigned char *)address >= rs->map && (unsigned char *)address < rs->map + rs->size;
+}
+
+void closeReadStream(readStream *rs) {
+    if (rs->map != NULL) {
+        munmap(rs->map, rs->size);
+    }
+    free(rs->buf);
+    // we will not read this file again, so keep the scan from evicting everyone else's pages
+    if (rs->config->dropCache) {
+        posix_fadvise(rs->fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(rs->fd);
+}
+
+// Chunk of a mapped file handed to a consumer under guardMappedAccess (consume, ctx, chunk, len)
+typedef struct mappedChunk {
+    void (*consume)(void *ctx, unsigned char *buf, size_t len);
+    void *ctx;
+    unsigned char *chunk;
+    size_t len;
+} mappedChunk;
+
+static void consumeMappedChunk(void *arg) {
+    mappedChunk *mc = arg;
+    mc->consume(mc->ctx, mc->chunk, mc->len);
+}
+
+bool readFileChunks(char *filename, readConfig *config, void (*consume)(void *ctx, unsigned char *buf, size_t len), void *ctx) {
+    readStream rs;
+    if (!openReadStream(&rs, filename, config)) {
+        return false;
+    }
+    unsigned char *chunk;
+    ssize_t got;
+    while ((got = nextReadChunk(&rs, &chunk)) > 0) {
+        if (rs.map == NULL) {
+            consume(ctx, chunk, got);
+            continue;
+        }
+        // a file truncated while it is mapped is a read error, not a crash
+        mappedChunk mc = {consume, ctx, chunk, got};
+        void *fault;
+        if (!guardMappedAccess(consumeMappedChunk, &mc, &fault)) {
+            got = -1;
+            break;
+        }
+    }
+    closeReadStream(&rs);
+    return got == 0;
+}
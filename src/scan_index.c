@@ -0,0 +1,509 @@
+#include "headers/scan_index.h"
+
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// Directory slot struct, where one scanned directory goes in the index (node, depth, index)
+typedef struct dirSlot {
+    pathNode *node;
+    uint32_t depth;     // directories above it, parents are written before their children
+    uint32_t index;
+} dirSlot;
+
+// Sort key struct for the lookup sections of the index (name, digest, position)
+typedef struct indexKey {
+    const char *name;
+    sha2Digest *digest;
+    uint32_t position;
+} indexKey;
+
+static int compareDirSlotNodes(const void *a, const void *b) {
+    uintptr_t na = (uintptr_t)((dirSlot *)a)->node, nb = (uintptr_t)((dirSlot *)b)->node;
+    return (na > nb) - (na < nb);
+}
+
+static int compareDirSlotDepths(const void *a, const void *b) {
+    dirSlot *da = *(dirSlot **)a, *db = *(dirSlot **)b;
+    if (da->depth != db->depth) {
+        return da->depth < db->depth ? -1 : 1;
+    }
+    return compareDirSlotNodes(da, db);
+}
+
+static int compareDigestWords(const sha2Digest *a, const sha2Digest *b) {
+    for (int i = 0; i < 4; i++) {
+        if (a->words[i] != b->words[i]) {
+            return a->words[i] < b->words[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int compareDigestKeys(const void *a, const void *b) {
+    return compareDigestWords(((indexKey *)a)->digest, ((indexKey *)b)->digest);
+}
+
+static int compareNameKeys(const void *a, const void *b) {
+    const indexKey *ka = a, *kb = b;
+    int cmp = strcmp(ka->name, kb->name);
+    return cmp != 0 ? cmp : (ka->position > kb->position) - (ka->position < kb->position);
+}
+
+static dirSlot *findDirSlot(dirSlot *slots, size_t numSlots, pathNode *node) {
+    dirSlot key = {node, 0, 0};
+    return bsearch(&key, slots, numSlots, sizeof(dirSlot), compareDirSlotNodes);
+}
+
+// every directory a file is in and every directory above those, numbered so that parents come first
+static dirSlot *collectDirs(SetCollection *sc, size_t numFiles, size_t *numDirs) {
+    size_t capacity = numFiles + 1, count = 0;
+    dirSlot *slots = malloc(capacity * sizeof(dirSlot));
+    CHECK_ALLOC(slots);
+    for (int i = 0; i < sc->numSets; i++) {
+        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
+            slots[count++] = (dirSlot){sc->sets[i]->files[j]->dir, 0, 0};
+        }
+    }
+    // twice: once for the directories holding files, once more with everything above them
+    for (int pass = 0; pass < 2; pass++) {
+        qsort(slots, count, sizeof(dirSlot), compareDirSlotNodes);
+        size_t numUnique = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (numUnique == 0 || slots[numUnique - 1].node != slots[i].node) {
+                slots[numUnique++] = slots[i];
+            }
+        }
+        count = numUnique;
+        if (pass == 1) {
+            break;
+        }
+        for (size_t i = 0; i < numUnique; i++) {
+            for (pathNode *parent = slots[i].node->parent; parent != NULL; parent = parent->parent) {
+                if (count == capacity) {
+                    capacity *= 2;
+                    slots = realloc(slots, capacity * sizeof(dirSlot));
+                    CHECK_ALLOC(slots);
+                }
+                slots[count++] = (dirSlot){parent, 0, 0};
+            }
+        }
+    }
+    dirSlot **byDepth = malloc((count + 1) * sizeof(dirSlot *));
+    CHECK_ALLOC(byDepth);
+    for (size_t i = 0; i < count; i++) {
+        for (pathNode *parent = slots[i].node->parent; parent != NULL; parent = parent->parent) {
+            slots[i].depth++;
+        }
+        byDepth[i] = &slots[i];
+    }
+    qsort(byDepth, count, sizeof(dirSlot *), compareDirSlotDepths);
+    for (size_t i = 0; i < count; i++) {
+        byDepth[i]->index = i;
+    }
+    free(byDepth);
+    *numDirs = count;
+    return slots;
+}
+
+// pad the file out to the next 8 byte boundary
+static bool writePadding(FILE *fp, size_t written) {
+    static const char zeros[8] = {0};
+    size_t pad = (8 - written % 8) % 8;
+    return pad == 0 || fwrite(zeros, pad, 1, fp) == 1;
+}
+
+static size_t alignedSize(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+// write the sections after the header, in the order the offsets were laid out
+static bool writeSections(FILE *fp, SetCollection *sc, indexHeader *header, dirSlot *dirs) {
+    size_t numDirs = header->numDirs;
+    bool ok = true;
+
+    // directories in index order, their names first in the names section
+    indexDir *outDirs = calloc(numDirs + 1, sizeof(indexDir));
+    CHECK_ALLOC(outDirs);
+    pathNode **dirNodes = malloc((numDirs + 1) * sizeof(pathNode *));
+    CHECK_ALLOC(dirNodes);
+    for (size_t i = 0; i < numDirs; i++) {
+        dirNodes[dirs[i].index] = dirs[i].node;
+    }
+    uint64_t nameOffset = 0;
+    for (size_t i = 0; i < numDirs; i++) {
+        pathNode *node = dirNodes[i];
+        outDirs[i].name = nameOffset;
+        outDirs[i].parent = node->parent != NULL ? findDirSlot(dirs, numDirs, node->parent)->index : INDEX_NO_PARENT;
+        nameOffset += strlen(node->name) + 1;
+    }
+    ok = ok && fwrite(outDirs, sizeof(indexDir), numDirs, fp) == numDirs;
+    free(outDirs);
+
+    // files grouped by set, then the sets pointing at their runs
+    for (int i = 0; i < sc->numSets && ok; i++) {
+        for (int j = 0; j < sc->sets[i]->numFiles && ok; j++) {
+            fileInfo *file = sc->sets[i]->files[j];
+            indexFile entry = {file->size, file->allocated, file->inode, file->device, nameOffset, findDirSlot(dirs, numDirs, file->dir)->index, i};
+            nameOffset += strlen(file->filename) + 1;
+            ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+        }
+    }
+    uint64_t position = 0;
+    for (int i = 0; i < sc->numSets && ok; i++) {
+        Set *set = sc->sets[i];
+        indexSet entry = {.firstFile = position, .numFiles = set->numFiles, .numInodes = set->numInodes, .hashed = set->hash != NULL};
+        if (set->hash != NULL) {
+            entry.digest = *set->hash;
+        }
+        for (int j = 0; j < set->numFiles; j++) {
+            entry.allocated += inodeOwner(set->files[j]) == set->files[j] ? set->files[j]->allocated : 0;
+        }
+        position += set->numFiles;
+        ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+    }
+
+    // the lookup sections, so -d and -f are a binary search each
+    indexKey *keys = malloc((header->numFiles + 1) * sizeof(indexKey));
+    CHECK_ALLOC(keys);
+    size_t numKeys = 0;
+    for (int i = 0; i < sc->numSets; i++) {
+        if (sc->sets[i]->hash != NULL) {
+            keys[numKeys++] = (indexKey){NULL, sc->sets[i]->hash, i};
+        }
+    }
+    qsort(keys, numKeys, sizeof(indexKey), compareDigestKeys);
+    for (size_t i = 0; i < numKeys && ok; i++) {
+        ok = fwrite(&keys[i].position, sizeof(uint32_t), 1, fp) == 1;
+    }
+    ok = ok && writePadding(fp, numKeys * sizeof(uint32_t));
+    numKeys = 0;
+    for (int i = 0; i < sc->numSets; i++) {
+        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
+            keys[numKeys] = (indexKey){sc->sets[i]->files[j]->filename, NULL, numKeys};
+            numKeys++;
+        }
+    }
+    qsort(keys, numKeys, sizeof(indexKey), compareNameKeys);
+    for (size_t i = 0; i < numKeys && ok; i++) {
+        ok = fwrite(&keys[i].position, sizeof(uint32_t), 1, fp) == 1;
+    }
+    ok = ok && writePadding(fp, numKeys * sizeof(uint32_t));
+    free(keys);
+
+    // the names, in the order their offsets were handed out
+    for (size_t i = 0; i < numDirs && ok; i++) {
+        ok = fwrite(dirNodes[i]->name, strlen(dirNodes[i]->name) + 1, 1, fp) == 1;
+    }
+    for (int i = 0; i < sc->numSets && ok; i++) {
+        for (int j = 0; j < sc->sets[i]->numFiles && ok; j++) {
+            ok = fwrite(sc->sets[i]->files[j]->filename, strlen(sc->sets[i]->files[j]->filename) + 1, 1, fp) == 1;
+        }
+    }
+    free(dirNodes);
+    return ok;
+}
+
+bool saveScanIndex(char *path, SetCollection *sc, char *algo) {
+    size_t numFiles = 0, numHashed = 0;
+    for (int i = 0; i < sc->numSets; i++) {
+        numFiles += sc->sets[i]->numFiles;
+        numHashed += sc->sets[i]->hash != NULL;
+    }
+    if (numFiles >= UINT32_MAX) {
+        fprintf(stderr, "Warning: Cannot write index %s, it would hold more than %u files\n", path, UINT32_MAX - 1);
+        return false;
+    }
+    size_t numDirs;
+    dirSlot *dirs = collectDirs(sc, numFiles, &numDirs);
+    size_t namesSize = 0;
+    for (size_t i = 0; i < numDirs; i++) {
+        namesSize += strlen(dirs[i].node->name) + 1;
+    }
+    for (int i = 0; i < sc->numSets; i++) {
+        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
+            namesSize += strlen(sc->sets[i]->files[j]->filename) + 1;
+        }
+    }
+
+    indexHeader header = {.version = SCAN_INDEX_VERSION, .headerSize = sizeof(indexHeader), .dirSize = sizeof(indexDir), .fileSize = sizeof(indexFile), .setSize = sizeof(indexSet),
+                          .numDirs = numDirs, .numFiles = numFiles, .numSets = sc->numSets, .numHashedSets = numHashed, .namesSize = namesSize};
+    memcpy(header.magic, SCAN_INDEX_MAGIC, sizeof(header.magic));
+    memcpy(header.algo, algo, strnlen(algo, sizeof(header.algo)));
+    header.dirsOffset = sizeof(indexHeader);
+    header.filesOffset = header.dirsOffset + numDirs * sizeof(indexDir);
+    header.setsOffset = header.filesOffset + numFiles * sizeof(indexFile);
+    header.byDigestOffset = header.setsOffset + sc->numSets * sizeof(indexSet);
+    header.byNameOffset = header.byDigestOffset + alignedSize(numHashed * sizeof(uint32_t));
+    header.namesOffset = header.byNameOffset + alignedSize(numFiles * sizeof(uint32_t));
+
+    // write a temporary file next to the index and rename it over, so a crash leaves the old index whole
+    size_t pathLen = strlen(path);
+    char *tmpPath = malloc(pathLen + sizeof(".XXXXXX"));
+    CHECK_ALLOC(tmpPath);
+    sprintf(tmpPath, "%s.XXXXXX", path);
+    int fd = mkstemp(tmpPath);
+    if (fd != -1) {
+        fchmod(fd, 0644);
+    }
+    FILE *fp = fd == -1 ? NULL : fdopen(fd, "w");
+    bool ok = fp != NULL;
+    ok = ok && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && writeSections(fp, sc, &header, dirs);
+    ok = ok && fflush(fp) == 0 && fsync(fd) == 0;
+    if (fp != NULL) {
+        ok = fclose(fp) == 0 && ok;
+    } else if (fd != -1) {
+        close(fd);
+    }
+    ok = ok && rename(tmpPath, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "Warning: Cannot write index %s: %s\n", path, strerror(errno));
+        if (fd != -1) {
+            unlink(tmpPath);
+        }
+    } else {
+        // make the rename itself durable
+        int dirFd = open(dirname(tmpPath), O_RDONLY | O_DIRECTORY);
+        if (dirFd != -1) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+    }
+    free(tmpPath);
+    free(dirs);
+    return ok;
+}
+
+// a section of count entries of size bytes at offset lies within the file and is aligned
+static bool validSection(uint64_t offset, uint64_t count, uint64_t size, size_t mapSize) {
+    return offset % 8 == 0 && offset <= mapSize && count <= (mapSize - offset) / size;
+}
+
+scanIndex *openScanIndex(char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1 || (size_t)statBuf.st_size < sizeof(indexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, statBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    size_t mapSize = statBuf.st_size;
+    indexHeader *header = data;
+    bool valid = memcmp(header->magic, SCAN_INDEX_MAGIC, sizeof(header->magic)) == 0 && header->version == SCAN_INDEX_VERSION
+        && header->headerSize == sizeof(indexHeader) && header->dirSize == sizeof(indexDir) && header->fileSize == sizeof(indexFile) && header->setSize == sizeof(indexSet)
+        && header->numFiles < UINT32_MAX && header->numSets <= header->numFiles && header->numHashedSets <= header->numSets
+        && validSection(header->dirsOffset, header->numDirs, sizeof(indexDir), mapSize)
+        && validSection(header->filesOffset, header->numFiles, sizeof(indexFile), mapSize)
+        && validSection(header->setsOffset, header->numSets, sizeof(indexSet), mapSize)
+        && validSection(header->byDigestOffset, header->numHashedSets, sizeof(uint32_t), mapSize)
+        && validSection(header->byNameOffset, header->numFiles, sizeof(uint32_t), mapSize)
+        && header->namesOffset <= mapSize && header->namesSize == mapSize - header->namesOffset
+        && (header->namesSize == 0 || ((char *)data)[mapSize - 1] == '\0');
+    if (!valid) {
+        munmap(data, mapSize);
+        return NULL;
+    }
+    scanIndex *si = calloc(1, sizeof(scanIndex));
+    CHECK_ALLOC(si);
+    si->map = data;
+    si->mapSize = mapSize;
+    si->header = header;
+    si->dirs = (indexDir *)((char *)data + header->dirsOffset);
+    si->files = (indexFile *)((char *)data + header->filesOffset);
+    si->sets = (indexSet *)((char *)data + header->setsOffset);
+    si->byDigest = (uint32_t *)((char *)data + header->byDigestOffset);
+    si->byName = (uint32_t *)((char *)data + header->byNameOffset);
+    si->names = (char *)data + header->namesOffset;
+    // directories only become path nodes when a file in them is printed
+    si->nodes = calloc(header->numDirs + 1, sizeof(pathNode *));
+    CHECK_ALLOC(si->nodes);
+    si->nodeArena = initArena();
+    return si;
+}
+
+// names are checked against the section when used, the last byte of the file ends any of them
+static char *indexName(scanIndex *si, uint64_t offset) {
+    return offset < si->header->namesSize ? si->names + offset : "";
+}
+
+// the path node of an index directory, built along with any missing ones above it (NULL for a bad index)
+static pathNode *indexPathNode(scanIndex *si, uint32_t dir) {
+    if (dir >= si->header->numDirs) {
+        return NULL;
+    }
+    if (si->nodes[dir] == NULL) {
+        // parents are always written before their children, which rules out a loop
+        uint32_t parent = si->dirs[dir].parent;
+        if (parent != INDEX_NO_PARENT && parent >= dir) {
+            return NULL;
+        }
+        pathNode *parentNode = parent != INDEX_NO_PARENT ? indexPathNode(si, parent) : NULL;
+        if (parent != INDEX_NO_PARENT && parentNode == NULL) {
+            return NULL;
+        }
+        si->nodes[dir] = initPathNode(si->nodeArena, parentNode, indexName(si, si->dirs[dir].name));
+    }
+    return si->nodes[dir];
+}
+
+// the files of one set as fileInfo records, enough for the reporters (false for a bad index, freeIndexSet either way)
+static bool loadIndexSet(scanIndex *si, uint32_t s, Set *set) {
+    indexSet *entry = &si->sets[s];
+    memset(set, 0, sizeof(Set));
+    if (entry->firstFile > si->header->numFiles || entry->numFiles > si->header->numFiles - entry->firstFile) {
+        return false;
+    }
+    fileInfo *records = calloc(entry->numFiles + 1, sizeof(fileInfo));
+    CHECK_ALLOC(records);
+    set->files = malloc((entry->numFiles + 1) * sizeof(fileInfo *));
+    CHECK_ALLOC(set->files);
+    set->files[0] = records;
+    set->hash = entry->hashed ? &entry->digest : NULL;
+    set->numInodes = entry->numInodes;
+    for (uint32_t i = 0; i < entry->numFiles; i++) {
+        indexFile *file = &si->files[entry->firstFile + i];
+        fileInfo *record = &records[i];
+        record->filename = indexName(si, file->name);
+        record->dir = indexPathNode(si, file->dir);
+        if (record->dir == NULL) {
+            return false;
+        }
+        record->size = file->size;
+        record->allocated = file->allocated;
+        record->inode = file->inode;
+        record->device = file->device;
+        set->files[set->numFiles++] = record;
+    }
+    set->capacity = set->numFiles;
+    return true;
+}
+
+static void freeIndexSet(Set *set) {
+    if (set->files != NULL) {
+        free(set->files[0]);
+        free(set->files);
+    }
+}
+
+static void reportBadIndex(void) {
+    fprintf(stderr, "Error: The index is damaged\n");
+}
+
+void indexDefaultPrint(scanIndex *si, bool quiet) {
+    summaryTotals totals = {0};
+    for (uint64_t i = 0; i < si->header->numSets; i++) {
+        indexSet *set = &si->sets[i];
+        if (set->numFiles == 0 || set->firstFile >= si->header->numFiles) {
+            reportBadIndex();
+            return;
+        }
+        indexFile *first = &si->files[set->firstFile];
+        totals.numFiles += set->numFiles;
+        totals.numUnique++;
+        totals.uniqueSize += first->size;
+        totals.size += first->size * set->numInodes;
+        totals.uniqueAllocated += first->allocated;
+        totals.allocated += set->allocated;
+    }
+    printSummary(&totals, quiet);
+}
+
+void indexListDuplicatesWithHash(scanIndex *si, char *hash) {
+    sha2Digest target;
+    if (!parseDigest(hash, &target)) {
+        printDuplicatesWithHash(hash, NULL);
+        return;
+    }
+    // binary search of the sets sorted by digest
+    size_t lo = 0, hi = si->header->numHashedSets;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (si->byDigest[mid] >= si->header->numSets) {
+            reportBadIndex();
+            return;
+        }
+        int cmp = compareDigestWords(&si->sets[si->byDigest[mid]].digest, &target);
+        if (cmp == 0) {
+            Set set = {0};
+            if (loadIndexSet(si, si->byDigest[mid], &set)) {
+                printDuplicatesWithHash(hash, &set);
+            } else {
+                reportBadIndex();
+            }
+            freeIndexSet(&set);
+            return;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    printDuplicatesWithHash(hash, NULL);
+}
+
+void indexListDuplicatesToFileNamed(scanIndex *si, char *filename) {
+    // the last file with the name in set order is in the set a scan would report, and it sorts last among them
+    size_t lo = 0, hi = si->header->numFiles;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (si->byName[mid] >= si->header->numFiles) {
+            reportBadIndex();
+            return;
+        }
+        if (strcmp(indexName(si, si->files[si->byName[mid]].name), filename) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || strcmp(indexName(si, si->files[si->byName[lo - 1]].name), filename) != 0) {
+        printDuplicatesToFileNamed(filename, NULL);
+        return;
+    }
+    uint32_t s = si->files[si->byName[lo - 1]].set;
+    Set set = {0};
+    if (s < si->header->numSets && loadIndexSet(si, s, &set)) {
+        printDuplicatesToFileNamed(filename, &set);
+    } else {
+        reportBadIndex();
+    }
+    freeIndexSet(&set);
+}
+
+void indexListAllDuplicates(scanIndex *si) {
+    printf("ALL DUPLICATE FILES:\n\n");
+    for (uint64_t i = 0; i < si->header->numSets; i++) {
+        if (si->sets[i].numFiles > 1) {
+            Set set = {0};
+            bool ok = loadIndexSet(si, i, &set);
+            if (ok) {
+                printDuplicateSet(&set, i + 1);
+            }
+            freeIndexSet(&set);
+            if (!ok) {
+                reportBadIndex();
+                return;
+            }
+        }
+    }
+    printf("-------------------------------------------------------------------------------------\n");
+}
+
+void freeScanIndex(scanIndex *si) {
+    if (si != NULL) {
+        munmap(si->map, si->mapSize);
+        free(si->nodes);
+        freeArena(si->nodeArena);
+        free(si);
+    }
+}
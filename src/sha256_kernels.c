@@ -0,0 +1,270 @@
+#include "headers/sha256_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+
+// round constants shared by every kernel
+static const uint32_t K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+char *sha256KernelName(sha256Kernel kernel) {
+    switch (kernel) {
+        case SHA256_SCALAR:
+            return "scalar";
+        case SHA256_SHANI:
+            return "shani";
+        case SHA256_AVX2:
+            return "avx2";
+        case SHA256_ARMV8:
+            return "armv8";
+        default:
+            return "auto";
+    }
+}
+
+bool parseSha256Kernel(char *str, sha256Kernel *kernel) {
+    sha256Kernel kernels[] = {SHA256_AUTO, SHA256_SCALAR, SHA256_SHANI, SHA256_AVX2, SHA256_ARMV8};
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (strcmp(str, sha256KernelName(kernels[i])) == 0) {
+            *kernel = kernels[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// AVX state must also be enabled by the OS, not just present in the CPU
+static bool osSavesYmm(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE)) {
+        return false;
+    }
+    unsigned int xcr0Low, xcr0High;
+    __asm__ volatile ("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    return (xcr0Low & 0x6) == 0x6;
+}
+
+bool cpuHasShaNi(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+bool cpuHasAvx2(void) {
+    unsigned int eax, ebx, ecx, edx;
+    return osSavesYmm() && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+
+bool cpuHasArmv8Sha2(void) {
+    return false;
+}
+
+void sha256_blocks_armv8(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    sha256_blocks_scalar(state, data, blocks);
+}
+
+// SHA-NI: each sha256rnds2 does two rounds, the state lives as ABEF/CDGH
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256_blocks_shani(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);    // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                      // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                           // CDGH
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i msg[4];
+
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * g)), byteSwap);
+            }
+            __m128i wk = _mm_add_epi32(msg[g & 3], _mm_loadu_si128((const __m128i *)&K[4 * g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+            // W[g+1..] schedule: W[h+1] from W[h-3], W[h-2], W[h-1], W[h]
+            if (g >= 3 && g < 15) {
+                __m128i w = _mm_sha256msg1_epu32(msg[(g + 1) & 3], msg[(g + 2) & 3]);
+                w = _mm_add_epi32(w, _mm_alignr_epi8(msg[g & 3], msg[(g + 3) & 3], 4));
+                msg[(g + 1) & 3] = _mm_sha256msg2_epu32(w, msg[g & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);    // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));    // HGFE
+}
+
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+// AVX2 multi-buffer: lane i of every register belongs to message i, so eight files advance one block per round
+__attribute__((target("avx2")))
+void sha256_blocks_x8(uint32_t *states[SHA256_LANES], const unsigned char *data[SHA256_LANES], size_t blocks) {
+    __m256i s[8];
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm256_setr_epi32(states[0][i], states[1][i], states[2][i], states[3][i],
+                                 states[4][i], states[5][i], states[6][i], states[7][i]);
+    }
+
+    for (size_t blk = 0; blk < blocks; blk++) {
+        __m256i w[64];
+        for (int t = 0; t < 16; t++) {
+            uint32_t lane[8];
+            for (int l = 0; l < 8; l++) {
+                uint32_t word;
+                memcpy(&word, data[l] + blk * 64 + 4 * t, 4);
+                lane[l] = __builtin_bswap32(word);
+            }
+            w[t] = _mm256_loadu_si256((const __m256i *)lane);
+        }
+        for (int t = 16; t < 64; t++) {
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w[t - 15], 7), ROTR8(w[t - 15], 18)), _mm256_srli_epi32(w[t - 15], 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w[t - 2], 17), ROTR8(w[t - 2], 19)), _mm256_srli_epi32(w[t - 2], 10));
+            w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+        }
+
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; t++) {
+            __m256i bigS1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(e, 6), ROTR8(e, 11)), ROTR8(e, 25));
+            __m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, bigS1), _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(K[t]), w[t])));
+            __m256i bigS0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(a, 2), ROTR8(a, 13)), ROTR8(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            __m256i t2 = _mm256_add_epi32(bigS0, maj);
+            h = g; g = f; f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c; c = b; b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+        s[0] = _mm256_add_epi32(s[0], a); s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c); s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e); s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g); s[7] = _mm256_add_epi32(s[7], h);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        uint32_t lane[8];
+        _mm256_storeu_si256((__m256i *)lane, s[i]);
+        for (int l = 0; l < 8; l++) {
+            states[l][i] = lane[l];
+        }
+    }
+}
+
+#elif defined(__aarch64__)
+
+bool cpuHasShaNi(void) {
+    return false;
+}
+
+bool cpuHasAvx2(void) {
+    return false;
+}
+
+bool cpuHasArmv8Sha2(void) {
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+
+void sha256_blocks_shani(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    sha256_blocks_scalar(state, data, blocks);
+}
+
+void sha256_blocks_x8(uint32_t *states[SHA256_LANES], const unsigned char *data[SHA256_LANES], size_t blocks) {
+    for (int l = 0; l < SHA256_LANES; l++) {
+        sha256_blocks_scalar(states[l], data[l], blocks);
+    }
+}
+
+// ARMv8: sha256h/sha256h2 do four rounds on the ABCD/EFGH halves, sha256su0/su1 extend the schedule
+__attribute__((target("+crypto")))
+void sha256_blocks_armv8(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32x4_t abcdSave = state0;
+        uint32x4_t efghSave = state1;
+        uint32x4_t msg[4];
+        for (int i = 0; i < 4; i++) {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        for (int g = 0; g < 16; g++) {
+            uint32x4_t wk = vaddq_u32(msg[g & 3], vld1q_u32(&K[4 * g]));
+            uint32x4_t abcd = state0;
+            state0 = vsha256hq_u32(state0, state1, wk);
+            state1 = vsha256h2q_u32(state1, abcd, wk);
+            // W[g+4] from W[g..g+3], replacing W[g] which is no longer needed
+            if (g < 12) {
+                msg[g & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[g & 3], msg[(g + 1) & 3]), msg[(g + 2) & 3], msg[(g + 3) & 3]);
+            }
+        }
+
+        state0 = vaddq_u32(state0, abcdSave);
+        state1 = vaddq_u32(state1, efghSave);
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+#else
+
+bool cpuHasShaNi(void) {
+    return false;
+}
+
+bool cpuHasAvx2(void) {
+    return false;
+}
+
+bool cpuHasArmv8Sha2(void) {
+    return false;
+}
+
+void sha256_blocks_shani(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    sha256_blocks_scalar(state, data, blocks);
+}
+
+void sha256_blocks_armv8(uint32_t state[8], const unsigned char *data, size_t blocks) {
+    sha256_blocks_scalar(state, data, blocks);
+}
+
+void sha256_blocks_x8(uint32_t *states[SHA256_LANES], const unsigned char *data[SHA256_LANES], size_t blocks) {
+    for (int l = 0; l < SHA256_LANES; l++) {
+        sha256_blocks_scalar(states[l], data[l], blocks);
+    }
+}
+
+#endif
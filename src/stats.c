@@ -0,0 +1,64 @@
+#include "headers/stats.h"
+
+#include <sys/resource.h>
+
+
+__thread ioCounters threadCounters;
+
+static ioCounters totalCounters;
+
+char *phaseName(runPhase phase) {
+    switch (phase) {
+        case PHASE_SCAN:
+            return "scan";
+        case PHASE_FINGERPRINT:
+            return "fingerprint";
+        case PHASE_HASH:
+            return "hash";
+        case PHASE_GROUP:
+            return "group";
+        default:
+            return "report";
+    }
+}
+
+// user and system time of every thread in the process so far
+static double processCpuSeconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+void startPhaseClock(phaseClock *clock) {
+    clock_gettime(CLOCK_MONOTONIC, &clock->wall);
+    clock->cpu = processCpuSeconds();
+}
+
+void stopPhaseClock(phaseClock *clock, phaseTime *time) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    time->wall += (now.tv_sec - clock->wall.tv_sec) + (now.tv_nsec - clock->wall.tv_nsec) / 1e9;
+    time->cpu += processCpuSeconds() - clock->cpu;
+}
+
+void flushThreadCounters(void) {
+    __atomic_fetch_add(&totalCounters.directories, threadCounters.directories, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalCounters.entries, threadCounters.entries, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalCounters.statCalls, threadCounters.statCalls, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalCounters.filesOpened, threadCounters.filesOpened, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalCounters.bytesRead, threadCounters.bytesRead, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalCounters.holeBytes, threadCounters.holeBytes, __ATOMIC_RELAXED);
+    memset(&threadCounters, 0, sizeof(ioCounters));
+}
+
+void getIoCounters(ioCounters *counters) {
+    // worker threads have all been joined by now, only this thread's counts are still its own
+    flushThreadCounters();
+    *counters = totalCounters;
+}
+
+long peakRssKb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
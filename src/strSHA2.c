@@ -30,13 +30,17 @@
  */
 
 #include "headers/strSHA2.h"
+#include "headers/sha256_kernels.h"
+#include "headers/stats.h"
+#include <sys/stat.h>
 
 #ifndef uint8
 #define uint8  unsigned char
 #endif
 
+// exactly 32 bits, unsigned long is 64 bits on LP64 hosts
 #ifndef uint32
-#define uint32 unsigned long int
+#define uint32 uint32_t
 #endif
 
 typedef struct
@@ -77,11 +81,15 @@ static void sha256_starts( sha256_context *ctx )
     ctx->state[7] = 0x5BE0CD19;
 }
 
-static void sha256_process( sha256_context *ctx, uint8 data[64] )
+// portable compression function, the fallback when the CPU has no SHA instructions
+void sha256_blocks_scalar( uint32 state[8], const uint8 *data, size_t blocks )
 {
     uint32 temp1, temp2, W[64];
     uint32 A, B, C, D, E, F, G, H;
 
+    for( ; blocks > 0; blocks--, data += 64 )
+    {
+
     GET_UINT32( W[0],  data,  0 );
     GET_UINT32( W[1],  data,  4 );
     GET_UINT32( W[2],  data,  8 );
@@ -124,14 +132,14 @@ static void sha256_process( sha256_context *ctx, uint8 data[64] )
     d += temp1; h = temp1 + temp2;              \
 }
 
-    A = ctx->state[0];
-    B = ctx->state[1];
-    C = ctx->state[2];
-    D = ctx->state[3];
-    E = ctx->state[4];
-    F = ctx->state[5];
-    G = ctx->state[6];
-    H = ctx->state[7];
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
+    F = state[5];
+    G = state[6];
+    H = state[7];
 
     P( A, B, C, D, E, F, G, H, W[ 0], 0x428A2F98 );
     P( H, A, B, C, D, E, F, G, W[ 1], 0x71374491 );
@@ -198,14 +206,64 @@ static void sha256_process( sha256_context *ctx, uint8 data[64] )
     P( C, D, E, F, G, H, A, B, R(62), 0xBEF9A3F7 );
     P( B, C, D, E, F, G, H, A, R(63), 0xC67178F2 );
 
-    ctx->state[0] += A;
-    ctx->state[1] += B;
-    ctx->state[2] += C;
-    ctx->state[3] += D;
-    ctx->state[4] += E;
-    ctx->state[5] += F;
-    ctx->state[6] += G;
-    ctx->state[7] += H;
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+    state[5] += F;
+    state[6] += G;
+    state[7] += H;
+    }
+}
+
+//  ----------------------------------------------------------------------
+
+//  Kernel dispatch: the compression function is picked once, before any
+//  hashing starts, and is read-only afterwards.
+
+static void (*sha256_blocks)( uint32 state[8], const uint8 *data, size_t blocks ) = sha256_blocks_scalar;
+static sha256Kernel sha256_kernel = SHA256_SCALAR;
+
+static sha256Kernel sha256_best_kernel( void )
+{
+    if( cpuHasShaNi() )  return SHA256_SHANI;
+    if( cpuHasArmv8Sha2() )  return SHA256_ARMV8;
+    if( cpuHasAvx2() )  return SHA256_AVX2;
+    return SHA256_SCALAR;
+}
+
+bool selectSha256Kernel(sha256Kernel kernel)
+{
+    if( kernel == SHA256_AUTO )
+        kernel = sha256_best_kernel();
+
+    switch( kernel )
+    {
+        case SHA256_SHANI:
+            if( ! cpuHasShaNi() )  return false;
+            sha256_blocks = sha256_blocks_shani;
+            break;
+        case SHA256_ARMV8:
+            if( ! cpuHasArmv8Sha2() )  return false;
+            sha256_blocks = sha256_blocks_armv8;
+            break;
+        case SHA256_AVX2:
+            // multi-buffer only helps across files, a single stream stays scalar
+            if( ! cpuHasAvx2() )  return false;
+            sha256_blocks = sha256_blocks_scalar;
+            break;
+        default:
+            sha256_blocks = sha256_blocks_scalar;
+            break;
+    }
+    sha256_kernel = kernel;
+    return true;
+}
+
+sha256Kernel getSha256Kernel(void)
+{
+    return sha256_kernel;
 }
 
 static void sha256_update( sha256_context *ctx, uint8 *input, uint32 length )
@@ -227,17 +285,17 @@ static void sha256_update( sha256_context *ctx, uint8 *input, uint32 length )
     {
         memcpy( (void *) (ctx->buffer + left),
                 (void *) input, fill );
-        sha256_process( ctx, ctx->buffer );
+        sha256_blocks( ctx->state, ctx->buffer, 1 );
         length -= fill;
         input  += fill;
         left = 0;
     }
 
-    while( length >= 64 )
+    if( length >= 64 )
     {
-        sha256_process( ctx, input );
-        length -= 64;
-        input  += 64;
+        sha256_blocks( ctx->state, input, length / 64 );
+        input  += length & ~0x3F;
+        length &= 0x3F;
     }
 
     if( length )
@@ -292,42 +350,500 @@ static void sha256_finish( sha256_context *ctx, uint8 digest[32] )
 extern	char	*strdup(const char *s);
 #endif
 
-#define	SHA2_DIGEST_LEN_BYTES		32
-#define	SHA2_DIGEST_LEN_STR		64
+void digestToHex(const sha2Digest *digest, char hex[SHA2_DIGEST_LEN_STR + 1])
+{
+    static const char	digits[] = "0123456789abcdef";
+    const uint8		*bytes = (const uint8 *) digest->words;
 
-char *strSHA2(char *filename)
+    for(int i=0 ; i<SHA2_DIGEST_LEN_BYTES ; i++) {
+	hex[2 * i]	= digits[bytes[i] >> 4];
+	hex[2 * i + 1]	= digits[bytes[i] & 0x0F];
+    }
+    hex[SHA2_DIGEST_LEN_STR]	= '\0';
+}
+
+static int hex_value( char c )
 {
-#if	defined(O_BINARY)
-    int	fd = open(filename, O_RDONLY | O_BINARY, 0);
-#else
-    int	fd = open(filename, O_RDONLY, 0);
-#endif
+    if( c >= '0' && c <= '9' )  return c - '0';
+    if( c >= 'a' && c <= 'f' )  return c - 'a' + 10;
+    if( c >= 'A' && c <= 'F' )  return c - 'A' + 10;
+    return -1;
+}
 
-    if(fd >= 0) {
-	sha256_context	ctx;
-	uint8		digest[SHA2_DIGEST_LEN_BYTES];
-	uint8		buf[ 1<<10 ];
-	int		got;
+bool parseDigestHex(const char *hex, sha2Digest *digest)
+{
+    uint8	*bytes = (uint8 *) digest->words;
+
+    for(int i=0 ; i<SHA2_DIGEST_LEN_BYTES ; i++) {
+	int hi = hex_value(hex[2 * i]);
+	int lo = hi < 0 ? -1 : hex_value(hex[2 * i + 1]);
+	if( hi < 0 || lo < 0 )
+	    return false;
+	bytes[i] = (uint8) ( ( hi << 4 ) | lo );
+    }
+    return hex[SHA2_DIGEST_LEN_STR] == '\0';
+}
 
-	sha256_starts(&ctx);
-	while((got = read(fd, buf, sizeof(buf))) > 0) {
-	    sha256_update(&ctx, buf, got);
-	}
-	sha256_finish(&ctx, digest);
+static void sha256_ops_init( void *ctx )
+{
+    sha256_starts( (sha256_context *) ctx );
+}
+
+static void sha256_ops_update( void *ctx, const unsigned char *buf, size_t len )
+{
+    sha256_update( (sha256_context *) ctx, (uint8 *) buf, (uint32) len );
+}
 
-	close(fd);
+static void sha256_ops_finish( void *ctx, sha2Digest *digest )
+{
+    sha256_finish( (sha256_context *) ctx, (uint8 *) digest->words );
+}
 
-	static char	str[SHA2_DIGEST_LEN_STR + 1];
-	char		*s = str;
+const digestOps sha256Ops = { "sha256", SHA2_DIGEST_LEN_BYTES, sizeof(sha256_context), sha256_ops_init, sha256_ops_update, sha256_ops_finish };
 
-	for(int i=0 ; i<SHA2_DIGEST_LEN_BYTES ; i++) {
-	    sprintf(s, "%02x", digest[i]);
-	    s += 2;
-	}
-	*s	= '\0';
+// read engine callback, feeds each chunk of the file to the digest
+static void sha256_consume( void *ctx, unsigned char *buf, size_t len )
+{
+    sha256_update( (sha256_context *) ctx, buf, len );
+}
+
+bool sha2File(char *filename, readConfig *config, sha2Digest *digest)
+{
+    sha256_context	ctx;
+
+    sha256_starts(&ctx);
+    if(!readFileChunks(filename, config, sha256_consume, &ctx)) {
+	return false;
+    }
+    sha256_finish(&ctx, (uint8 *) digest->words);
+    return true;
+}
+
+char *strSHA2(char *filename)
+{
+    readConfig	config = defaultReadConfig();
+    sha2Digest	digest;
+    char	str[SHA2_DIGEST_LEN_STR + 1];
+
+    if(!sha2File(filename, &config, &digest)) {
+	return NULL;
+    }
+    digestToHex(&digest, str);
     char *rv = strdup(str);
     CHECK_ALLOC(rv);
     return rv;
+}
+
+//  ----------------------------------------------------------------------
+
+//  Multi-buffer hashing: up to SHA256_LANES files are read side by side and
+//  their full blocks pushed through the AVX2 kernel together. A lane whose
+//  file ends takes the next file off the shared counter.
+
+typedef struct
+{
+    bool	active;
+    int		index;
+    readStream	rs;
+    sha256_context	ctx;
+    unsigned char	*chunk;
+    size_t	len;
+} sha256_lane;
+
+// account for bytes compressed outside sha256_update
+static void sha256_add_total( sha256_context *ctx, size_t length )
+{
+    uint32 low = ctx->total[0];
+
+    ctx->total[0] += (uint32) length;
+    ctx->total[1] += (uint32) ( (uint64_t) length >> 32 );
+    if( ctx->total[0] < low )
+        ctx->total[1]++;
+}
+
+// guardMappedAccess callback, hashes the bytes left in a lane's chunk
+static void sha256_lane_consume( void *arg )
+{
+    sha256_lane *lane = (sha256_lane *) arg;
+
+    sha256_update(&lane->ctx, lane->chunk, lane->len);
+}
+
+// give up on a lane's file, its digest is left unset
+static void sha256_lane_drop( sha256_lane *lane, bool *hashed )
+{
+    hashed[lane->index] = false;
+    closeReadStream(&lane->rs);
+    lane->active = false;
+}
+
+// get the lane to at least one full block of data, finishing files and starting new ones as needed
+static void sha256_lane_fill( sha256_lane *lane, char **filenames, sha2Digest *digests, bool *hashed, int *next, int numFiles, readConfig *config )
+{
+    for(;;) {
+	if( ! lane->active ) {
+	    int i = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+	    if( i >= numFiles )
+		return;
+	    if( ! openReadStream(&lane->rs, filenames[i], config) ) {
+		hashed[i] = false;
+		continue;
+	    }
+	    lane->active = true;
+	    lane->index = i;
+	    lane->len = 0;
+	    sha256_starts(&lane->ctx);
+	}
+	// once bytes sit in the context buffer, the rest of the file goes through sha256_update
+	if( lane->len >= 64 && ( lane->ctx.total[0] & 0x3F ) == 0 )
+	    return;
+	if( lane->len > 0 ) {
+	    void *fault;
+	    if( lane->rs.map == NULL )
+		sha256_lane_consume(lane);
+	    else if( ! guardMappedAccess(sha256_lane_consume, lane, &fault) ) {
+		sha256_lane_drop(lane, hashed);
+		continue;
+	    }
+	    lane->len = 0;
+	}
+	ssize_t got = nextReadChunk(&lane->rs, &lane->chunk);
+	if( got > 0 ) {
+	    lane->len = got;
+	    continue;
+	}
+	if( got == 0 )
+	    sha256_finish(&lane->ctx, (uint8 *) digests[lane->index].words);
+	hashed[lane->index] = got == 0;
+	closeReadStream(&lane->rs);
+	lane->active = false;
+    }
+}
+
+// Full blocks of every active lane compressed in one go (lanes, first, numActive, blocks)
+typedef struct
+{
+    sha256_lane	*lanes;
+    int		first;
+    int		numActive;
+    size_t	blocks;
+} sha256_batch;
+
+// guardMappedAccess callback, compresses one batch
+static void sha256_batch_compress( void *arg )
+{
+    sha256_batch	*batch = (sha256_batch *) arg;
+    sha256_lane		*lanes = batch->lanes;
+    uint32		*states[SHA256_LANES];
+    const uint8	*data[SHA256_LANES];
+    uint32		scratch[8];
+
+    if( batch->numActive == 1 ) {
+	// one file left, eight lanes of work for one lane of output is a loss
+	sha256_blocks(lanes[batch->first].ctx.state, lanes[batch->first].chunk, batch->blocks);
+	return;
+    }
+    // idle lanes compress a copy of a live lane's data into scratch
+    for(int l=0 ; l<SHA256_LANES ; l++) {
+	states[l] = lanes[l].active ? lanes[l].ctx.state : scratch;
+	data[l] = lanes[lanes[l].active ? l : batch->first].chunk;
+    }
+    sha256_blocks_x8(states, data, batch->blocks);
+}
+
+void sha2FileLanes(char **filenames, sha2Digest *digests, bool *hashed, int *next, int numFiles, readConfig *config)
+{
+    sha256_lane		lanes[SHA256_LANES];
+
+    memset(lanes, 0, sizeof(lanes));
+    for(int l=0 ; l<SHA256_LANES ; l++)
+	sha256_lane_fill(&lanes[l], filenames, digests, hashed, next, numFiles, config);
+
+    for(;;) {
+	uint32		saved[SHA256_LANES][8];
+	void		*fault;
+	int		numActive = 0;
+	int		first = -1;
+	size_t		blocks = SIZE_MAX;
+
+	for(int l=0 ; l<SHA256_LANES ; l++) {
+	    if( lanes[l].active ) {
+		numActive++;
+		if( first < 0 )
+		    first = l;
+		if( lanes[l].len / 64 < blocks )
+		    blocks = lanes[l].len / 64;
+	    }
+	}
+	if( numActive == 0 )
+	    break;
+
+	// a mapped file truncated under us faults part way through, so every lane goes back to where it was and that file is dropped
+	sha256_batch batch = { lanes, first, numActive, blocks };
+	for(int l=0 ; l<SHA256_LANES ; l++)
+	    memcpy(saved[l], lanes[l].ctx.state, sizeof(saved[l]));
+	if( ! guardMappedAccess(sha256_batch_compress, &batch, &fault) ) {
+	    for(int l=0 ; l<SHA256_LANES ; l++) {
+		memcpy(lanes[l].ctx.state, saved[l], sizeof(saved[l]));
+		if( lanes[l].active && streamMapHolds(&lanes[l].rs, fault) ) {
+		    sha256_lane_drop(&lanes[l], hashed);
+		    sha256_lane_fill(&lanes[l], filenames, digests, hashed, next, numFiles, config);
+		}
+	    }
+	    continue;
+	}
+
+	for(int l=0 ; l<SHA256_LANES ; l++) {
+	    if( lanes[l].active ) {
+		sha256_add_total(&lanes[l].ctx, blocks * 64);
+		lanes[l].chunk += blocks * 64;
+		lanes[l].len -= blocks * 64;
+		sha256_lane_fill(&lanes[l], filenames, digests, hashed, next, numFiles, config);
+	    }
+	}
     }
-    return NULL;
-}
\ No newline at end of file
+}
+
+//  ----------------------------------------------------------------------
+
+//  io_uring pipeline: up to URING_QUEUE_DEPTH files are open at once, each
+//  with one read in flight into its own registered buffer. Every completion
+//  is hashed as it arrives and the file's next read queued straight away, so
+//  one thread keeps the device busy with many outstanding reads. Any digest
+//  with streaming ops can be used, not just SHA-256.
+
+typedef struct
+{
+    int		index;		// -1 when the slot is free
+    int		fd;
+    size_t	size;
+    size_t	offset;
+    void	*ctx;		// ops->ctxSize bytes
+    unsigned char	*buf;
+    bool	sparse;		// holes are hashed as zeros, only the data extents are read
+    size_t	dataStart;
+    size_t	dataEnd;
+    bool	reading;	// a read into buf is with the kernel, buf and fd must be left alone
+} sha256_uring_slot;
+
+static void sha256_uring_close( sha256_uring_slot *slot, readConfig *config )
+{
+    if( config->dropCache )
+	posix_fadvise(slot->fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(slot->fd);
+    slot->index = -1;
+}
+
+// queue the slot's next read, hashing any hole before it as zeros on the way, false if the file ends first
+static bool sha256_uring_queue( const digestOps *ops, uring *ring, sha256_uring_slot *slot, int s, size_t bufferSize )
+{
+    size_t	end = slot->size;
+
+    while( slot->sparse && slot->offset < slot->size ) {
+	if( slot->offset >= slot->dataEnd )
+	    findDataExtent(slot->fd, slot->offset, slot->size, &slot->dataStart, &slot->dataEnd);
+	if( slot->offset >= slot->dataStart ) {
+	    end = slot->dataEnd;
+	    break;
+	}
+	size_t	zeros = slot->dataStart - slot->offset < bufferSize ? slot->dataStart - slot->offset : bufferSize;
+	memset(slot->buf, 0, zeros);
+	ops->update(slot->ctx, slot->buf, zeros);
+	COUNT_IO(holeBytes, zeros);
+	slot->offset += zeros;
+    }
+    if( slot->offset >= slot->size )
+	return false;
+
+    size_t	len = end - slot->offset < bufferSize ? end - slot->offset : bufferSize;
+
+    // the ring has an entry per slot, so there is always room
+    queueUringRead(ring, slot->fd, slot->buf, (unsigned) len, slot->offset, s, (uint64_t) s);
+    slot->reading = true;
+    return true;
+}
+
+// give a free slot the next file and queue its first read, false once no files are left
+static bool sha256_uring_start( const digestOps *ops, uring *ring, sha256_uring_slot *slot, int s, char **filenames, sha2Digest *digests, bool *hashed, int *next, int numFiles, readConfig *config, size_t bufferSize )
+{
+    for(;;) {
+	int i = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED);
+	if( i >= numFiles )
+	    return false;
+	struct stat	statBuf;
+	slot->fd = open(filenames[i], O_RDONLY | O_CLOEXEC);
+	if( slot->fd == -1 ) {
+	    hashed[i] = false;
+	    continue;
+	}
+	COUNT_IO(filesOpened, 1);
+	COUNT_IO(statCalls, 1);
+	if( fstat(slot->fd, &statBuf) == -1 ) {
+	    close(slot->fd);
+	    hashed[i] = false;
+	    continue;
+	}
+	posix_fadvise(slot->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	slot->index = i;
+	slot->size = statBuf.st_size;
+	slot->offset = 0;
+	slot->sparse = isSparse(&statBuf);
+	slot->dataStart = slot->dataEnd = 0;
+	ops->init(slot->ctx);
+	if( ! sha256_uring_queue(ops, ring, slot, s, bufferSize) ) {
+	    ops->finish(slot->ctx, &digests[i]);
+	    hashed[i] = true;
+	    sha256_uring_close(slot, config);
+	    continue;
+	}
+	return true;
+    }
+}
+
+// Digest fed by readFileChunks (ops, ctx)
+typedef struct
+{
+    const digestOps	*ops;
+    void		*ctx;
+} sha256_uring_sink;
+
+// read engine callback, feeds each chunk of the file to the slot's digest
+static void sha256_uring_consume( void *arg, unsigned char *buf, size_t len )
+{
+    sha256_uring_sink *sink = (sha256_uring_sink *) arg;
+
+    sink->ops->update(sink->ctx, buf, len);
+}
+
+// wait out every read the kernel still has, false if the ring fails before they all complete
+static bool sha256_uring_drain( uring *ring, sha256_uring_slot *slots, int depth )
+{
+    uint64_t	userData;
+    int		res;
+
+    // reads never submitted are taken back, the kernel has not seen them
+    while( unqueueUringRead(ring, &userData) )
+	slots[userData].reading = false;
+    for(;;) {
+	while( nextUringCompletion(ring, &userData, &res) )
+	    slots[userData].reading = false;
+	int	s = 0;
+	while( s < depth && ! slots[s].reading )
+	    s++;
+	if( s == depth )
+	    return true;
+	int	rv = waitUring(ring, 1);
+	if( rv < 0 && rv != -EAGAIN && rv != -EBUSY )
+	    return false;
+    }
+}
+
+// the ring failed with the slot's file part way through, so it is hashed again from the start with plain reads
+static void sha256_uring_reread( const digestOps *ops, sha256_uring_slot *slot, char **filenames, sha2Digest *digests, bool *hashed, readConfig *config )
+{
+    sha256_uring_sink	sink = { ops, slot->ctx };
+    int			i = slot->index;
+
+    // readFileChunks has buffers of its own; a read that never completed keeps its fd, a leak but never a reused descriptor
+    if( slot->reading )
+	slot->index = -1;
+    else
+	sha256_uring_close(slot, config);
+    ops->init(slot->ctx);
+    hashed[i] = readFileChunks(filenames[i], config, sha256_uring_consume, &sink);
+    if( hashed[i] )
+	ops->finish(slot->ctx, &digests[i]);
+}
+
+bool hashFilesUring(const digestOps *ops, char **filenames, sha2Digest *digests, bool *hashed, int *next, int numFiles, readConfig *config)
+{
+    // keep the buffers of all slots together within URING_BUFFER_BUDGET
+    size_t	bufferSize = config->bufferSize;
+    int		depth = URING_QUEUE_DEPTH;
+
+    if( bufferSize * depth > URING_BUFFER_BUDGET )
+	depth = bufferSize >= URING_BUFFER_BUDGET ? 1 : (int) ( URING_BUFFER_BUDGET / bufferSize );
+
+    uring	ring;
+    if( ! initUring(&ring, depth) )
+	return false;
+
+    sha256_uring_slot	*slots = calloc(depth, sizeof(sha256_uring_slot));
+    struct iovec	*iovs = calloc(depth, sizeof(struct iovec));
+    size_t		ctxStride = ( ops->ctxSize + 63 ) & ~(size_t) 63;
+    unsigned char	*contexts = calloc(depth, ctxStride);
+    unsigned char	*buffers;
+    CHECK_ALLOC(slots);
+    CHECK_ALLOC(iovs);
+    CHECK_ALLOC(contexts);
+    if( posix_memalign((void **) &buffers, READ_BUFFER_MIN, bufferSize * depth) != 0 ) {
+	perror(__func__);
+	exit(1);
+    }
+    for(int s=0 ; s<depth ; s++) {
+	slots[s].index	= -1;
+	slots[s].buf	= buffers + s * bufferSize;
+	slots[s].ctx	= contexts + s * ctxStride;
+	iovs[s].iov_base	= slots[s].buf;
+	iovs[s].iov_len	= bufferSize;
+    }
+    // pinned buffers save the kernel mapping pages for every read, plain reads still work without them
+    registerUringBuffers(&ring, iovs, depth);
+
+    int		active = 0;
+    bool	failed = false;
+    bool	drained = true;
+    for(int s=0 ; s<depth ; s++)
+	active += sha256_uring_start(ops, &ring, &slots[s], s, filenames, digests, hashed, next, numFiles, config, bufferSize);
+
+    while( active > 0 ) {
+	// one call submits every read queued since the last one and waits for a completion
+	int	rv = submitUring(&ring, 1);
+	if( rv < 0 && rv != -EAGAIN && rv != -EBUSY ) {
+	    // the files not taken yet are left for the caller to hash without the ring
+	    drained = sha256_uring_drain(&ring, slots, depth);
+	    for(int s=0 ; s<depth ; s++) {
+		if( slots[s].index >= 0 )
+		    sha256_uring_reread(ops, &slots[s], filenames, digests, hashed, config);
+	    }
+	    failed = true;
+	    break;
+	}
+
+	uint64_t	userData;
+	int		res;
+	while( nextUringCompletion(&ring, &userData, &res) ) {
+	    int			s = (int) userData;
+	    sha256_uring_slot	*slot = &slots[s];
+
+	    slot->reading = false;
+	    if( res == -EINTR || res == -EAGAIN ) {
+		sha256_uring_queue(ops, &ring, slot, s, bufferSize);
+		continue;
+	    }
+	    if( res > 0 ) {
+		ops->update(slot->ctx, slot->buf, (size_t) res);
+		COUNT_IO(bytesRead, res);
+		slot->offset += res;
+		if( sha256_uring_queue(ops, &ring, slot, s, bufferSize) )
+		    continue;
+	    }
+	    // done: the whole file was read (or it shrank, a 0 read), or the read failed
+	    if( res >= 0 )
+		ops->finish(slot->ctx, &digests[slot->index]);
+	    hashed[slot->index] = res >= 0;
+	    sha256_uring_close(slot, config);
+	    if( ! sha256_uring_start(ops, &ring, slot, s, filenames, digests, hashed, next, numFiles, config, bufferSize) )
+		active--;
+	}
+    }
+
+    freeUring(&ring);
+    // closing the ring does not wait for reads already running, so buffers they may still fill are leaked
+    if( drained )
+	free(buffers);
+    free(contexts);
+    free(iovs);
+    free(slots);
+    return ! failed;
+}
@@ -0,0 +1,164 @@
+#include "headers/uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+// liburing is not a dependency, the three system calls are all the rings need
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, void *arg, unsigned numArgs) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, numArgs);
+}
+
+bool uringAvailable(void) {
+    // -1 unknown, then 0 or 1; probed before any worker thread starts
+    static int available = -1;
+    if (available == -1) {
+        uring ring;
+        available = initUring(&ring, 1);
+        if (available) {
+            freeUring(&ring);
+        } else {
+            fprintf(stderr, "Warning: io_uring is not available (%s), reading files synchronously\n", strerror(errno));
+        }
+    }
+    return available;
+}
+
+bool initUring(uring *ring, unsigned entries) {
+    memset(ring, 0, sizeof(uring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = uringSetup(entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+        ring->sqMapSize = ring->cqMapSize = ring->sqMapSize > ring->cqMapSize ? ring->sqMapSize : ring->cqMapSize;
+    }
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqMap == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+    ring->cqMap = singleMap ? ring->sqMap : mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = ring->cqMap == MAP_FAILED ? MAP_FAILED : mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->cqMap != MAP_FAILED && !singleMap) {
+            munmap(ring->cqMap, ring->cqMapSize);
+        }
+        munmap(ring->sqMap, ring->sqMapSize);
+        close(ring->fd);
+        return false;
+    }
+    char *sq = ring->sqMap;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->sqEntries = params.sq_entries;
+    char *cq = ring->cqMap;
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool registerUringBuffers(uring *ring, struct iovec *iovs, unsigned numIovs) {
+    ring->fixedBuffers = uringRegister(ring->fd, IORING_REGISTER_BUFFERS, iovs, numIovs) == 0;
+    return ring->fixedBuffers;
+}
+
+bool queueUringRead(uring *ring, int fd, void *buf, unsigned len, uint64_t offset, int bufIndex, uint64_t userData) {
+    unsigned tail = *ring->sqTail;
+    if (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries) {
+        return false;
+    }
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ring->fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->buf_index = ring->fixedBuffers ? bufIndex : 0;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    // the kernel may read the entry as soon as it sees the new tail
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->toSubmit++;
+    return true;
+}
+
+int submitUring(uring *ring, unsigned minComplete) {
+    for (;;) {
+        int submitted = uringEnter(ring->fd, ring->toSubmit, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (submitted >= 0) {
+            ring->toSubmit -= submitted;
+            return submitted;
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
+int waitUring(uring *ring, unsigned minComplete) {
+    for (;;) {
+        if (uringEnter(ring->fd, 0, minComplete, IORING_ENTER_GETEVENTS) >= 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
+bool unqueueUringRead(uring *ring, uint64_t *userData) {
+    unsigned tail = *ring->sqTail;
+    if (tail == __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    // without SQPOLL the kernel only reads entries inside io_uring_enter, so the tail can be pulled back
+    tail--;
+    *userData = ring->sqes[ring->sqArray[tail & *ring->sqMask]].user_data;
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    if (ring->toSubmit > 0) {
+        ring->toSubmit--;
+    }
+    return true;
+}
+
+bool nextUringCompletion(uring *ring, uint64_t *userData, int *res) {
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+    *userData = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void freeUring(uring *ring) {
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqMap != ring->sqMap) {
+        munmap(ring->cqMap, ring->cqMapSize);
+    }
+    munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+}
@@ -0,0 +1,549 @@
+#include "headers/watch.h"
+
+
+// FNV-1a, names are short and only one is looked up at a time
+static unsigned long nameHash(const char *name) {
+    unsigned long hash = 14695981039346656037UL;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 1099511628211UL;
+    }
+    return hash;
+}
+
+static watchedFile **nameBucket(watcher *w, const char *name) {
+    return &w->buckets[nameHash(name) & (w->numBuckets - 1)];
+}
+
+// The link to the record of the name in dir, or to the NULL ending its bucket's chain
+static watchedFile **findWatchedFile(watcher *w, pathNode *dir, const char *name) {
+    watchedFile **link = nameBucket(w, name);
+    // every scanned directory has one node, so a pointer compare settles all but the names
+    while (*link != NULL && ((*link)->file->dir != dir || strcmp((*link)->file->filename, name) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Double the buckets once there are more names than buckets, keeping chains short
+static void growWatchedFiles(watcher *w) {
+    watchedFile **oldBuckets = w->buckets;
+    int oldNumBuckets = w->numBuckets;
+    w->numBuckets *= 2;
+    w->buckets = calloc(w->numBuckets, sizeof(watchedFile *));
+    CHECK_ALLOC(w->buckets);
+    for (int i = 0; i < oldNumBuckets; i++) {
+        while (oldBuckets[i] != NULL) {
+            watchedFile *wf = oldBuckets[i];
+            oldBuckets[i] = wf->next;
+            watchedFile **bucket = nameBucket(w, wf->file->filename);
+            wf->next = *bucket;
+            *bucket = wf;
+        }
+    }
+    free(oldBuckets);
+}
+
+static void addWatchedFile(watcher *w, fileInfo *file, int set) {
+    watchedFile *wf = w->freeFiles;
+    if (wf != NULL) {
+        w->freeFiles = wf->next;
+    } else {
+        wf = arenaAlloc(w->st->arenas[0], sizeof(watchedFile));
+    }
+    watchedFile **bucket = nameBucket(w, file->filename);
+    *wf = (watchedFile){file, set, *bucket};
+    *bucket = wf;
+    if (++w->numFiles > w->numBuckets) {
+        growWatchedFiles(w);
+    }
+}
+
+// write dir/name into buf (false if it needs more than PATH_MAX bytes)
+static bool namePath(pathNode *dir, const char *name, char buf[PATH_MAX]) {
+    size_t nameLen = strlen(name);
+    if (dir->length + 1 + nameLen >= PATH_MAX) {
+        return false;
+    }
+    buildDirPath(dir, buf);
+    buf[dir->length] = '/';
+    memcpy(buf + dir->length + 1, name, nameLen + 1);
+    return true;
+}
+
+// hash one file by its path, or give it the digest of its inode's primary
+static bool hashWatchedFile(watcher *w, fileInfo *file) {
+    if (file->primary != NULL && file->primary->hashed) {
+        file->hash = file->primary->hash;
+        file->hashed = true;
+        return true;
+    }
+    char path[PATH_MAX];
+    if (!buildFilePath(file, path, sizeof(path)) || !hashFile(w->ops, path, &w->config, &file->hash)) {
+        return false;
+    }
+    file->hashed = true;
+    return true;
+}
+
+// a group's files that were left unhashed while their size or fingerprint was unique are hashed and moved into digest sets, primaries first so each set counts its inodes from them
+static void hashSizeGroup(watcher *w, sizeGroup *group, fileInfo *except) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < group->numFiles; i++) {
+            fileInfo *file = group->files[i];
+            if (file == except || file->hashed || (file->primary == NULL) != (pass == 0)) {
+                continue;
+            }
+            watchedFile *wf = *findWatchedFile(w, file->dir, file->filename);
+            if (wf == NULL || wf->file != file || !hashWatchedFile(w, file)) {
+                continue;
+            }
+            removeFileSet(w->sc, wf->set, file);
+            wf->set = addFileSet(w->sc, file);
+        }
+    }
+}
+
+// a new or rewritten name joins its size group and, once it shares its size with another file, a digest set
+static void addFile(watcher *w, fileInfo *file) {
+    addFileSizeTable(w->st, file);
+    sizeGroup *group = getSizeGroup(w->st, file->size);
+    if (group->numFiles > 1) {
+        hashSizeGroup(w, group, file);
+        hashWatchedFile(w, file);
+    }
+    addWatchedFile(w, file, addFileSet(w->sc, file));
+    w->totalsValid = false;
+}
+
+// a name that is gone leaves its set and size group, its record is kept for the next name
+static void removeFile(watcher *w, watchedFile **link) {
+    watchedFile *wf = *link;
+    *link = wf->next;
+    // the set counts inodes by primary, so it goes before the primary is handed on
+    removeFileSet(w->sc, wf->set, wf->file);
+    removeFileSizeTable(w->st, wf->file);
+    wf->next = w->freeFiles;
+    w->freeFiles = wf;
+    w->numFiles--;
+    w->totalsValid = false;
+}
+
+// an inode was rewritten through one name, so all of its names hold the new contents
+static void refreshInode(watcher *w, fileInfo *old, struct stat *statBuf) {
+    // every name of an inode is in its size group, gathered first since removing them reshapes it
+    sizeGroup *group = getSizeGroup(w->st, old->size);
+    fileInfo **names = malloc(group->numFiles * sizeof(fileInfo *));
+    CHECK_ALLOC(names);
+    int numNames = 0;
+    for (int i = 0; i < group->numFiles; i++) {
+        if (group->files[i]->device == old->device && group->files[i]->inode == old->inode) {
+            names[numNames++] = group->files[i];
+        }
+    }
+    for (int i = 0; i < numNames; i++) {
+        watchedFile **link = findWatchedFile(w, names[i]->dir, names[i]->filename);
+        if (*link != NULL && (*link)->file == names[i]) {
+            removeFile(w, link);
+        }
+    }
+    // removed records stay in the arena, so their names can still be copied
+    for (int i = 0; i < numNames; i++) {
+        addFile(w, initFileInfo(w->st->arenas[0], names[i]->dir, names[i]->filename, statBuf));
+    }
+    free(names);
+}
+
+// bring one name in dir in line with what is on disk now
+static void updateName(watcher *w, pathNode *dir, const char *name) {
+    char path[PATH_MAX];
+    if (!namePath(dir, name, path)) {
+        return;
+    }
+    watchedFile **link = findWatchedFile(w, dir, name);
+    struct stat statBuf;
+    // stat() like the scan, so a symlink counts as the file it points at
+    if (stat(path, &statBuf) == -1 || !S_ISREG(statBuf.st_mode)) {
+        if (*link != NULL) {
+            removeFile(w, link);
+        }
+        return;
+    }
+    fileInfo *old = *link != NULL ? (*link)->file : NULL;
+    if (old != NULL && old->device == statBuf.st_dev && old->inode == statBuf.st_ino) {
+        // closed without a write, or a new link to it made elsewhere
+        if (old->size == (size_t)statBuf.st_size && old->mtime.tv_sec == statBuf.st_mtim.tv_sec && old->mtime.tv_nsec == statBuf.st_mtim.tv_nsec) {
+            return;
+        }
+        refreshInode(w, old, &statBuf);
+        return;
+    }
+    // the name now leads to another inode, moved over it or recreated
+    if (old != NULL) {
+        removeFile(w, link);
+    }
+    addFile(w, initFileInfo(w->st->arenas[0], dir, name, &statBuf));
+}
+
+// subscribe to a directory's events, remembering its node by watch descriptor
+static bool watchDir(watcher *w, pathNode *dir) {
+    char path[PATH_MAX];
+    if (dir->length >= sizeof(path)) {
+        return false;
+    }
+    buildDirPath(dir, path);
+    int wd = inotify_add_watch(w->inotifyFd, path, WATCH_EVENTS);
+    if (wd == -1) {
+        // past the limit every directory fails the same way, once is enough to say so
+        if (errno != ENOSPC) {
+            fprintf(stderr, "Error: Cannot watch directory %s: %s\n", path, strerror(errno));
+        } else if (!w->outOfWatches) {
+            fprintf(stderr, "Error: Cannot watch directory %s and those after it, raise fs.inotify.max_user_watches\n", path);
+            w->outOfWatches = true;
+        }
+        return false;
+    }
+    if (wd >= w->numDirs) {
+        int oldNumDirs = w->numDirs;
+        w->numDirs = wd * 2 + 16;
+        w->dirs = realloc(w->dirs, w->numDirs * sizeof(pathNode *));
+        CHECK_ALLOC(w->dirs);
+        memset(&w->dirs[oldNumDirs], 0, (w->numDirs - oldNumDirs) * sizeof(pathNode *));
+    }
+    // a directory reached twice through a symlink has one descriptor, its first node keeps it
+    if (w->dirs[wd] == NULL) {
+        w->dirs[wd] = dir;
+    }
+    return true;
+}
+
+static void readWatchedDir(watcher *w, pathNode *dir, bool withSubdirs);
+
+// a directory created or moved into the tree is watched and read like the scan would have
+static void addTree(watcher *w, pathNode *parent, const char *name) {
+    pathNode *dir = initPathNode(w->st->arenas[0], parent, name);
+    // watched before it is read, so a file created in between is seen by one or the other
+    watchDir(w, dir);
+    readWatchedDir(w, dir, true);
+}
+
+// check every name in a directory against the disk, adding the subdirectories too if withSubdirs
+static void readWatchedDir(watcher *w, pathNode *dir, bool withSubdirs) {
+    char path[PATH_MAX];
+    if (dir->length >= sizeof(path)) {
+        return;
+    }
+    buildDirPath(dir, path);
+    DIR *d = opendir(path);
+    if (d == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        struct stat statBuf;
+        if (fstatat(dirfd(d), entry->d_name, &statBuf, 0) == -1) {
+            continue;
+        }
+        if (S_ISDIR(statBuf.st_mode)) {
+            if (withSubdirs && w->recursive) {
+                addTree(w, dir, entry->d_name);
+            }
+        } else if (S_ISREG(statBuf.st_mode) && (w->hidden || !isHidden(entry->d_name))) {
+            updateName(w, dir, entry->d_name);
+        }
+    }
+    closedir(d);
+}
+
+static bool isUnder(pathNode *node, pathNode *dir) {
+    for (; node != NULL; node = node->parent) {
+        if (node == dir) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// a directory moved out of the tree (or renamed, the new name arrives on its own) takes its files and watches with it
+static void dropTree(watcher *w, pathNode *parent, const char *name) {
+    pathNode *dir = NULL;
+    for (int wd = 0; wd < w->numDirs && dir == NULL; wd++) {
+        if (w->dirs[wd] != NULL && w->dirs[wd]->parent == parent && strcmp(w->dirs[wd]->name, name) == 0) {
+            dir = w->dirs[wd];
+        }
+    }
+    if (dir == NULL) {
+        return;
+    }
+    for (int wd = 0; wd < w->numDirs; wd++) {
+        if (w->dirs[wd] != NULL && isUnder(w->dirs[wd], dir)) {
+            inotify_rm_watch(w->inotifyFd, wd);
+            w->dirs[wd] = NULL;
+        }
+    }
+    for (int i = 0; i < w->numBuckets; i++) {
+        watchedFile **link = &w->buckets[i];
+        while (*link != NULL) {
+            if (isUnder((*link)->file->dir, dir)) {
+                removeFile(w, link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+}
+
+// events were dropped, so every watched name is checked against the disk again; unchanged files are not read
+static void resyncWatchedDirs(watcher *w) {
+    for (int i = 0; i < w->numBuckets; i++) {
+        watchedFile **link = &w->buckets[i];
+        while (*link != NULL) {
+            char path[PATH_MAX];
+            struct stat statBuf;
+            if (!buildFilePath((*link)->file, path, sizeof(path)) || stat(path, &statBuf) == -1 || !S_ISREG(statBuf.st_mode)) {
+                removeFile(w, link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+    // a subdirectory cannot be told from a known one without a lookup per entry, so only files are picked up here
+    for (int wd = 0; wd < w->numDirs; wd++) {
+        if (w->dirs[wd] != NULL) {
+            readWatchedDir(w, w->dirs[wd], false);
+        }
+    }
+}
+
+static void handleEvent(watcher *w, struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, "Error: Too many changes at once, checking every watched file again\n");
+        resyncWatchedDirs(w);
+        return;
+    }
+    if (event->wd < 0 || event->wd >= w->numDirs || w->dirs[event->wd] == NULL) {
+        return;
+    }
+    pathNode *dir = w->dirs[event->wd];
+    // the directory itself was deleted or unmounted, its files went with their own events
+    if (event->mask & IN_IGNORED) {
+        w->dirs[event->wd] = NULL;
+        return;
+    }
+    if (event->len == 0) {
+        return;
+    }
+    if (event->mask & IN_ISDIR) {
+        if (!w->recursive) {
+            return;
+        }
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            addTree(w, dir, event->name);
+        } else if (event->mask & IN_MOVED_FROM) {
+            dropTree(w, dir, event->name);
+        }
+        return;
+    }
+    if (!w->hidden && isHidden(event->name)) {
+        return;
+    }
+    if (event->mask & IN_CREATE) {
+        // a file being written is read once it is closed, only new links and symlinks are complete when created
+        char path[PATH_MAX];
+        struct stat statBuf;
+        if (!namePath(dir, event->name, path) || lstat(path, &statBuf) == -1 || (S_ISREG(statBuf.st_mode) && statBuf.st_nlink < 2)) {
+            return;
+        }
+    }
+    updateName(w, dir, event->name);
+}
+
+static void readEvents(watcher *w) {
+    char buf[WATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t numRead;
+    while ((numRead = read(w->inotifyFd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + numRead; ) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+            handleEvent(w, event);
+        }
+    }
+}
+
+// the set holding a file with the name, the last one in set order like a scan's -f
+static Set *findNamedSet(watcher *w, char *filename) {
+    int last = -1;
+    for (watchedFile *wf = *nameBucket(w, filename); wf != NULL; wf = wf->next) {
+        if (wf->set > last && strcmp(wf->file->filename, filename) == 0) {
+            last = wf->set;
+        }
+    }
+    return last != -1 ? w->sc->sets[last] : NULL;
+}
+
+static void runQuery(watcher *w, char *query, char *arg) {
+    if (strcmp(query, "summary") == 0 || strcmp(query, "quiet") == 0) {
+        if (!w->totalsValid) {
+            countSummary(w->sc, &w->totals);
+            w->totalsValid = true;
+        }
+        printSummary(&w->totals, strcmp(query, "quiet") == 0);
+    } else if (strcmp(query, "list") == 0) {
+        listAllDuplicates(w->sc);
+    } else if (strcmp(query, "hash") == 0 && arg != NULL) {
+        listDuplicatesWithHash(arg, w->sc);
+    } else if (strcmp(query, "file") == 0 && arg != NULL) {
+        printDuplicatesToFileNamed(arg, findNamedSet(w, arg));
+    } else {
+        printf("Error: Unknown query %s, expected summary, quiet, list, hash <hash> or file <name>\n", query);
+    }
+}
+
+// read one query line from a client and answer it with the same reporters as a scan
+static void answerQuery(watcher *w, int client) {
+    // a client that stalls cannot hold up the events behind it for long
+    struct timeval timeout = {WATCH_CLIENT_TIMEOUT, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    char query[WATCH_QUERY_MAX];
+    size_t len = 0;
+    ssize_t numRead;
+    while (len < sizeof(query) - 1 && (numRead = read(client, query + len, sizeof(query) - 1 - len)) > 0) {
+        len += numRead;
+        if (memchr(query, '\n', len) != NULL) {
+            break;
+        }
+    }
+    query[len] = '\0';
+    query[strcspn(query, "\r\n")] = '\0';
+    // a name may hold spaces, so the argument is the rest of the line
+    char *arg = strchr(query, ' ');
+    if (arg != NULL) {
+        *arg++ = '\0';
+    }
+
+    // the reporters print to stdout, so it points at the client while one runs
+    fflush(stdout);
+    dup2(client, STDOUT_FILENO);
+    runQuery(w, query, arg);
+    fflush(stdout);
+    // a client that left early only loses its own answer
+    clearerr(stdout);
+    dup2(w->stdoutFd, STDOUT_FILENO);
+    close(client);
+}
+
+static int listenOn(char *socketPath) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path %s is too long\n", socketPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+    // a socket left by a daemon that did not exit cleanly is replaced, anything else at the path is not touched
+    struct stat statBuf;
+    if (lstat(socketPath, &statBuf) == 0 && S_ISSOCK(statBuf.st_mode)) {
+        unlink(socketPath);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", socketPath, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int watchDirs(char *socketPath, sizeTable *st, SetCollection *sc, optionList *optList) {
+    watcher w = {0};
+    w.st = st;
+    w.sc = sc;
+    w.ops = getDigestOps(getHashAlgo());
+    w.config = getReadConfig(optList);
+    w.recursive = getOption(optList, 'r') != NULL;
+    w.hidden = getOption(optList, 'a') != NULL;
+    w.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w.inotifyFd == -1) {
+        fprintf(stderr, "Error: Cannot watch for changes: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    w.listenFd = listenOn(socketPath);
+    if (w.listenFd == -1) {
+        close(w.inotifyFd);
+        return EXIT_FAILURE;
+    }
+    w.stdoutFd = dup(STDOUT_FILENO);
+    // answers go out in large writes rather than a line at a time
+    setvbuf(stdout, NULL, _IOFBF, 0);
+
+    w.numBuckets = WATCH_MIN_BUCKETS;
+    w.buckets = calloc(w.numBuckets, sizeof(watchedFile *));
+    CHECK_ALLOC(w.buckets);
+    for (int i = 0; i < sc->numSets; i++) {
+        for (int j = 0; j < sc->sets[i]->numFiles; j++) {
+            addWatchedFile(&w, sc->sets[i]->files[j], i);
+        }
+    }
+    // a change made between the scan and here is only seen once that file changes again
+    for (int i = 0; i < st->numDirs; i++) {
+        watchDir(&w, st->dirs[i]);
+    }
+
+    // the stop signals are read from a descriptor polled with the others, so the loop never stops halfway through a change
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, NULL);
+    int signalFd = signalfd(-1, &stopSignals, SFD_CLOEXEC);
+    if (signalFd == -1) {
+        // without it the daemon could only be killed, leaving its socket behind
+        perror("signalfd");
+        sigprocmask(SIG_UNBLOCK, &stopSignals, NULL);
+        unlink(socketPath);
+        close(w.listenFd);
+        close(w.inotifyFd);
+        close(w.stdoutFd);
+        free(w.dirs);
+        free(w.buckets);
+        return EXIT_FAILURE;
+    }
+    // a client that hangs up early must not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Watching %d files in %d directories, answering queries on %s\n", w.numFiles, st->numDirs, socketPath);
+    struct pollfd fds[3] = {{w.inotifyFd, POLLIN, 0}, {w.listenFd, POLLIN, 0}, {signalFd, POLLIN, 0}};
+    while (!(fds[2].revents & POLLIN)) {
+        if (poll(fds, 3, -1) == -1) {
+            if (errno != EINTR) {
+                perror("poll");
+                break;
+            }
+            continue;
+        }
+        // changes are applied first, so a query never sees the tree as it was before an event already queued
+        if (fds[0].revents & POLLIN) {
+            readEvents(&w);
+        }
+        if (fds[1].revents & POLLIN) {
+            int client = accept(w.listenFd, NULL, NULL);
+            if (client != -1) {
+                answerQuery(&w, client);
+            }
+        }
+    }
+
+    close(signalFd);
+    unlink(socketPath);
+    close(w.listenFd);
+    close(w.inotifyFd);
+    close(w.stdoutFd);
+    free(w.dirs);
+    free(w.buckets);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+#include "headers/workers.h"
+
+
+static void *workerLoop(void *arg) {
+    workerJob *job = arg;
+    int item;
+    // items are handed out one at a time, so a few huge files cannot leave other threads idle
+    while ((item = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->numItems) {
+        job->work(job->arg, item);
+    }
+    flushThreadCounters();
+    return NULL;
+}
+
+void runWorkers(int numThreads, void (*work)(void *arg, int item), void *arg, int numItems) {
+    workerJob job = {work, arg, numItems, 0};
+    if (numThreads > numItems) {
+        numThreads = numItems;
+    }
+    // a single thread runs inline, no need to spawn anything
+    if (numThreads <= 1) {
+        workerLoop(&job);
+        return;
+    }
+    pthread_t *threads = calloc(numThreads - 1, sizeof(pthread_t));
+    CHECK_ALLOC(threads);
+    int numStarted = 0;
+    for (int i = 0; i < numThreads - 1; i++) {
+        if (pthread_create(&threads[i], NULL, workerLoop, &job) != 0) {
+            fprintf(stderr, "Error: Cannot start worker thread, continuing with %d\n", numStarted + 1);
+            break;
+        }
+        numStarted++;
+    }
+    // the calling thread works too
+    workerLoop(&job);
+    for (int i = 0; i < numStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+
+static void *queuedLoop(void *arg) {
+    queuedJob *job = arg;
+    for (;;) {
+        // join the queue with the fewest threads that still has items and room, so every device gets one before any gets a second
+        pthread_mutex_lock(&job->lock);
+        workQueue *queue = NULL;
+        for (int i = 0; i < job->numQueues; i++) {
+            workQueue *q = &job->queues[i];
+            if (q->active < q->limit && __atomic_load_n(&q->next, __ATOMIC_RELAXED) < q->numItems && (queue == NULL || q->active < queue->active)) {
+                queue = q;
+            }
+        }
+        if (queue != NULL) {
+            queue->active++;
+        }
+        pthread_mutex_unlock(&job->lock);
+        // a queue only opens up once it is drained, and then its own threads look again, so nothing is left behind
+        if (queue == NULL) {
+            break;
+        }
+        int item;
+        while ((item = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->numItems) {
+            job->work(job->arg, queue->items[item]);
+        }
+        pthread_mutex_lock(&job->lock);
+        queue->active--;
+        pthread_mutex_unlock(&job->lock);
+    }
+    flushThreadCounters();
+    return NULL;
+}
+
+void runQueuedWorkers(int numThreads, void (*work)(void *arg, int item), void *arg, workQueue *queues, int numQueues) {
+    queuedJob job = {work, arg, queues, numQueues, PTHREAD_MUTEX_INITIALIZER};
+    // no more threads than the queues can take at once
+    int maxThreads = 0;
+    for (int i = 0; i < numQueues; i++) {
+        maxThreads += queues[i].limit < queues[i].numItems ? queues[i].limit : queues[i].numItems;
+    }
+    if (numThreads > maxThreads) {
+        numThreads = maxThreads;
+    }
+    if (numThreads <= 1) {
+        queuedLoop(&job);
+        pthread_mutex_destroy(&job.lock);
+        return;
+    }
+    pthread_t *threads = calloc(numThreads - 1, sizeof(pthread_t));
+    CHECK_ALLOC(threads);
+    int numStarted = 0;
+    for (int i = 0; i < numThreads - 1; i++) {
+        if (pthread_create(&threads[i], NULL, queuedLoop, &job) != 0) {
+            fprintf(stderr, "Error: Cannot start worker thread, continuing with %d\n", numStarted + 1);
+            break;
+        }
+        numStarted++;
+    }
+    // the calling thread works too
+    queuedLoop(&job);
+    for (int i = 0; i < numStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+    free(threads);
+}
+
+static void pushBottom(workDeque *dq, void *item) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->capacity) {
+        int newCapacity = dq->capacity == 0 ? 64 : dq->capacity * 2;
+        void **newItems = malloc(newCapacity * sizeof(void *));
+        CHECK_ALLOC(newItems);
+        // unwrap the ring into the new array
+        for (int i = 0; i < dq->count; i++) {
+            newItems[i] = dq->items[(dq->top + i) % dq->capacity];
+        }
+        free(dq->items);
+        dq->items = newItems;
+        dq->capacity = newCapacity;
+        dq->top = 0;
+    }
+    dq->items[(dq->top + dq->count) % dq->capacity] = item;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static void *popBottom(workDeque *dq) {
+    void *item = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        dq->count--;
+        item = dq->items[(dq->top + dq->count) % dq->capacity];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return item;
+}
+
+static void *stealTop(workDeque *dq) {
+    void *item = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        item = dq->items[dq->top];
+        dq->top = (dq->top + 1) % dq->capacity;
+        dq->count--;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return item;
+}
+
+void pushStealPool(stealPool *pool, int thread, void *item) {
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+    pushBottom(&pool->deques[thread], item);
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    // an idle thread bumps idle before checking queued, so one of the two always sees the other
+    if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->idleLock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->idleLock);
+    }
+}
+
+typedef struct stealThread {
+    stealPool *pool;
+    int thread;
+} stealThread;
+
+static void *stealLoop(void *arg) {
+    stealPool *pool = ((stealThread *)arg)->pool;
+    int self = ((stealThread *)arg)->thread;
+    for (;;) {
+        // own deque first (newest item, depth first), then steal the oldest item of the others
+        void *item = popBottom(&pool->deques[self]);
+        for (int i = 1; item == NULL && i < pool->numThreads; i++) {
+            item = stealTop(&pool->deques[(self + i) % pool->numThreads]);
+        }
+        if (item != NULL) {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            pool->work(pool, self, item);
+            if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+                pthread_mutex_lock(&pool->idleLock);
+                pthread_cond_broadcast(&pool->wake);
+                pthread_mutex_unlock(&pool->idleLock);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&pool->idleLock);
+        __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0 && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) > 0) {
+            pthread_cond_wait(&pool->wake, &pool->idleLock);
+        }
+        __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        bool done = __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&pool->idleLock);
+        if (done) {
+            flushThreadCounters();
+            return NULL;
+        }
+    }
+}
+
+void runStealPool(int numThreads, void (*work)(stealPool *pool, int thread, void *item), void *arg, void **seeds, int numSeeds) {
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+    stealPool pool = {0};
+    pool.numThreads = numThreads;
+    pool.work = work;
+    pool.arg = arg;
+    pool.deques = calloc(numThreads, sizeof(workDeque));
+    CHECK_ALLOC(pool.deques);
+    for (int i = 0; i < numThreads; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    }
+    pthread_mutex_init(&pool.idleLock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+
+    // deal the seeds out round robin so every root starts on its own thread
+    for (int i = 0; i < numSeeds; i++) {
+        pushStealPool(&pool, i % numThreads, seeds[i]);
+    }
+
+    stealThread *threads = calloc(numThreads, sizeof(stealThread));
+    CHECK_ALLOC(threads);
+    pthread_t *ids = calloc(numThreads, sizeof(pthread_t));
+    CHECK_ALLOC(ids);
+    int numStarted = 0;
+    for (int i = 1; i < numThreads; i++) {
+        threads[i] = (stealThread){&pool, i};
+        if (pthread_create(&ids[i], NULL, stealLoop, &threads[i]) != 0) {
+            fprintf(stderr, "Error: Cannot start worker thread, continuing with %d\n", numStarted + 1);
+            break;
+        }
+        numStarted++;
+    }
+    // threads that failed to start still own a deque, the others steal from it
+    threads[0] = (stealThread){&pool, 0};
+    stealLoop(&threads[0]);
+    for (int i = 1; i <= numStarted; i++) {
+        pthread_join(ids[i], NULL);
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].items);
+    }
+    pthread_mutex_destroy(&pool.idleLock);
+    pthread_cond_destroy(&pool.wake);
+    free(pool.deques);
+    free(threads);
+    free(ids);
+}
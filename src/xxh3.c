@@ -0,0 +1,361 @@
+/*
+ *  XXH3-128 (xxHash 0.8), seed 0 and the default secret, streaming only.
+ *  Written from the xxHash specification and reference implementation by
+ *  Yann Collet (BSD 2-Clause), and produces the same digests as XXH3_128bits.
+ */
+
+#include "headers/xxh3.h"
+#include "headers/sha256_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define PRIME_MX1 0x165667919E3779F9ULL
+#define PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define SECRET_SIZE 192
+#define SECRET_LIMIT (SECRET_SIZE - XXH3_STRIPE_LEN)
+#define SECRET_CONSUME_RATE 8
+#define SECRET_LASTACC_START 7
+#define SECRET_MERGEACCS_START 11
+#define SECRET_SIZE_MIN 136
+#define MIDSIZE_MAX 240
+#define MIDSIZE_STARTOFFSET 3
+#define MIDSIZE_LASTOFFSET 17
+#define STRIPES_PER_BLOCK (SECRET_LIMIT / SECRET_CONSUME_RATE)
+
+_Static_assert(sizeof(xxh128State) <= DIGEST_CONTEXT_MAX, "xxh128State does not fit a digest context");
+
+static const unsigned char kSecret[SECRET_SIZE] __attribute__((aligned(64))) = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+// 128-bit value as two halves (low, high)
+typedef struct u128 {
+    uint64_t low;
+    uint64_t high;
+} u128;
+
+
+static inline uint32_t readLE32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t readLE64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u128 mult64to128(uint64_t a, uint64_t b) {
+    unsigned __int128 product = (unsigned __int128)a * b;
+    u128 r = {(uint64_t)product, (uint64_t)(product >> 64)};
+    return r;
+}
+
+static inline uint64_t mul128Fold64(uint64_t a, uint64_t b) {
+    u128 product = mult64to128(a, b);
+    return product.low ^ product.high;
+}
+
+static inline uint32_t rotl32(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint64_t xxh64Avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3Avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t mix16B(const unsigned char *input, const unsigned char *secret) {
+    return mul128Fold64(readLE64(input) ^ readLE64(secret), readLE64(input + 8) ^ readLE64(secret + 8));
+}
+
+static inline u128 mix32B(u128 acc, const unsigned char *input1, const unsigned char *input2, const unsigned char *secret) {
+    acc.low += mix16B(input1, secret);
+    acc.low ^= readLE64(input2) + readLE64(input2 + 8);
+    acc.high += mix16B(input2, secret + 16);
+    acc.high ^= readLE64(input1) + readLE64(input1 + 8);
+    return acc;
+}
+
+// the shared finish of the 17 to 240 byte paths
+static u128 finishMidsize(u128 acc, size_t len) {
+    u128 h;
+    h.low = xxh3Avalanche(acc.low + acc.high);
+    h.high = 0 - xxh3Avalanche(acc.low * PRIME64_1 + acc.high * PRIME64_4 + len * PRIME64_2);
+    return h;
+}
+
+// inputs of at most MIDSIZE_MAX bytes each have their own small hash, with seed 0 throughout
+static u128 hashShort(const unsigned char *input, size_t len) {
+    const unsigned char *secret = kSecret;
+    u128 h;
+    if (len == 0) {
+        h.low = xxh64Avalanche(readLE64(secret + 64) ^ readLE64(secret + 72));
+        h.high = xxh64Avalanche(readLE64(secret + 80) ^ readLE64(secret + 88));
+    } else if (len <= 3) {
+        uint32_t combinedl = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) | input[len - 1] | ((uint32_t)len << 8);
+        uint32_t combinedh = rotl32(__builtin_bswap32(combinedl), 13);
+        h.low = xxh64Avalanche(combinedl ^ (uint64_t)(readLE32(secret) ^ readLE32(secret + 4)));
+        h.high = xxh64Avalanche(combinedh ^ (uint64_t)(readLE32(secret + 8) ^ readLE32(secret + 12)));
+    } else if (len <= 8) {
+        uint64_t input64 = readLE32(input) + ((uint64_t)readLE32(input + len - 4) << 32);
+        uint64_t keyed = input64 ^ (readLE64(secret + 16) ^ readLE64(secret + 24));
+        h = mult64to128(keyed, PRIME64_1 + (len << 2));
+        h.high += h.low << 1;
+        h.low ^= h.high >> 3;
+        h.low ^= h.low >> 35;
+        h.low *= PRIME_MX2;
+        h.low ^= h.low >> 28;
+        h.high = xxh3Avalanche(h.high);
+    } else if (len <= 16) {
+        uint64_t bitflipl = readLE64(secret + 32) ^ readLE64(secret + 40);
+        uint64_t bitfliph = readLE64(secret + 48) ^ readLE64(secret + 56);
+        uint64_t inputLo = readLE64(input);
+        uint64_t inputHi = readLE64(input + len - 8);
+        u128 m = mult64to128(inputLo ^ inputHi ^ bitflipl, PRIME64_1);
+        m.low += (uint64_t)(len - 1) << 54;
+        inputHi ^= bitfliph;
+        m.high += inputHi + (uint64_t)(uint32_t)inputHi * (PRIME32_2 - 1);
+        m.low ^= __builtin_bswap64(m.high);
+        h = mult64to128(m.low, PRIME64_2);
+        h.high += m.high * PRIME64_2;
+        h.low = xxh3Avalanche(h.low);
+        h.high = xxh3Avalanche(h.high);
+    } else if (len <= 128) {
+        u128 acc = {len * PRIME64_1, 0};
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc = mix32B(acc, input + 48, input + len - 64, secret + 96);
+                }
+                acc = mix32B(acc, input + 32, input + len - 48, secret + 64);
+            }
+            acc = mix32B(acc, input + 16, input + len - 32, secret + 32);
+        }
+        acc = mix32B(acc, input, input + len - 16, secret);
+        h = finishMidsize(acc, len);
+    } else {
+        u128 acc = {len * PRIME64_1, 0};
+        for (size_t i = 32; i < 160; i += 32) {
+            acc = mix32B(acc, input + i - 32, input + i - 16, secret + i - 32);
+        }
+        acc.low = xxh3Avalanche(acc.low);
+        acc.high = xxh3Avalanche(acc.high);
+        for (size_t i = 160; i <= len; i += 32) {
+            acc = mix32B(acc, input + i - 32, input + i - 16, secret + MIDSIZE_STARTOFFSET + i - 160);
+        }
+        acc = mix32B(acc, input + len - 16, input + len - 32, secret + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET - 16);
+        h = finishMidsize(acc, len);
+    }
+    return h;
+}
+
+// portable accumulate: each 64-byte stripe adds into eight 64-bit lanes
+static void accumulateScalar(uint64_t acc[8], const unsigned char *input, const unsigned char *secret, size_t stripes) {
+    for (size_t n = 0; n < stripes; n++) {
+        const unsigned char *stripe = input + n * XXH3_STRIPE_LEN;
+        const unsigned char *key = secret + n * SECRET_CONSUME_RATE;
+        for (int i = 0; i < 8; i++) {
+            uint64_t dataVal = readLE64(stripe + 8 * i);
+            uint64_t dataKey = dataVal ^ readLE64(key + 8 * i);
+            acc[i ^ 1] += dataVal;
+            acc[i] += (uint64_t)(uint32_t)dataKey * (dataKey >> 32);
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// AVX2 accumulate: two registers of four lanes, the same arithmetic as the scalar loop
+__attribute__((target("avx2")))
+static void accumulateAvx2(uint64_t acc[8], const unsigned char *input, const unsigned char *secret, size_t stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 4));
+    for (size_t n = 0; n < stripes; n++) {
+        const unsigned char *stripe = input + n * XXH3_STRIPE_LEN;
+        const unsigned char *key = secret + n * SECRET_CONSUME_RATE;
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)stripe);
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)(stripe + 32));
+        __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i *)key));
+        __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i *)(key + 32)));
+        // low half times high half of each keyed lane, and the data added to the neighbouring lane
+        a0 = _mm256_add_epi64(a0, _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32)));
+        a1 = _mm256_add_epi64(a1, _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32)));
+        a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2)));
+        a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+    _mm256_storeu_si256((__m256i *)acc, a0);
+    _mm256_storeu_si256((__m256i *)(acc + 4), a1);
+}
+
+#endif
+
+static void (*accumulate)(uint64_t acc[8], const unsigned char *input, const unsigned char *secret, size_t stripes) = accumulateScalar;
+
+void selectXxh128Kernel(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (cpuHasAvx2()) {
+        accumulate = accumulateAvx2;
+    }
+#endif
+}
+
+static void scrambleAcc(uint64_t acc[8], const unsigned char *secret) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= readLE64(secret + 8 * i);
+        a *= PRIME32_1;
+        acc[i] = a;
+    }
+}
+
+// accumulate stripes, scrambling at each block boundary of the secret, and return the input after them
+static const unsigned char *consumeStripes(uint64_t acc[8], size_t *stripesSoFar, const unsigned char *input, size_t stripes) {
+    const unsigned char *secret = kSecret + *stripesSoFar * SECRET_CONSUME_RATE;
+    if (stripes >= STRIPES_PER_BLOCK - *stripesSoFar) {
+        size_t thisIter = STRIPES_PER_BLOCK - *stripesSoFar;
+        do {
+            accumulate(acc, input, secret, thisIter);
+            scrambleAcc(acc, kSecret + SECRET_LIMIT);
+            input += thisIter * XXH3_STRIPE_LEN;
+            stripes -= thisIter;
+            thisIter = STRIPES_PER_BLOCK;
+            secret = kSecret;
+        } while (stripes >= STRIPES_PER_BLOCK);
+        *stripesSoFar = 0;
+    }
+    if (stripes > 0) {
+        accumulate(acc, input, secret, stripes);
+        input += stripes * XXH3_STRIPE_LEN;
+        *stripesSoFar += stripes;
+    }
+    return input;
+}
+
+static uint64_t mergeAccs(const uint64_t acc[8], const unsigned char *secret, uint64_t start) {
+    uint64_t result = start;
+    for (int i = 0; i < 4; i++) {
+        result += mul128Fold64(acc[2 * i] ^ readLE64(secret + 16 * i), acc[2 * i + 1] ^ readLE64(secret + 16 * i + 8));
+    }
+    return xxh3Avalanche(result);
+}
+
+void xxh128Reset(xxh128State *state) {
+    static const uint64_t initAcc[8] = {PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1};
+    memcpy(state->acc, initAcc, sizeof(initAcc));
+    state->bufferedSize = 0;
+    state->stripesSoFar = 0;
+    state->totalLen = 0;
+}
+
+void xxh128Update(xxh128State *state, const unsigned char *input, size_t len) {
+    const unsigned char *end = input + len;
+    state->totalLen += len;
+    if (len <= XXH3_BUFFER_SIZE - state->bufferedSize) {
+        memcpy(state->buffer + state->bufferedSize, input, len);
+        state->bufferedSize += len;
+        return;
+    }
+    // top up and consume the buffer, then stream straight from the input
+    if (state->bufferedSize > 0) {
+        size_t load = XXH3_BUFFER_SIZE - state->bufferedSize;
+        memcpy(state->buffer + state->bufferedSize, input, load);
+        input += load;
+        consumeStripes(state->acc, &state->stripesSoFar, state->buffer, XXH3_BUFFER_SIZE / XXH3_STRIPE_LEN);
+        state->bufferedSize = 0;
+    }
+    if (end - input > XXH3_BUFFER_SIZE) {
+        // hold back at least one byte, the last stripe is special
+        size_t stripes = (size_t)(end - 1 - input) / XXH3_STRIPE_LEN;
+        input = consumeStripes(state->acc, &state->stripesSoFar, input, stripes);
+        // keep the last whole stripe in case fewer than a stripe of bytes follow
+        memcpy(state->buffer + XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN, input - XXH3_STRIPE_LEN, XXH3_STRIPE_LEN);
+    }
+    memcpy(state->buffer, input, end - input);
+    state->bufferedSize = end - input;
+}
+
+void xxh128Digest(xxh128State *state, sha2Digest *digest) {
+    u128 h;
+    if (state->totalLen > MIDSIZE_MAX) {
+        uint64_t acc[8];
+        unsigned char lastStripe[XXH3_STRIPE_LEN];
+        const unsigned char *lastStripePtr;
+        size_t stripesSoFar = state->stripesSoFar;
+        memcpy(acc, state->acc, sizeof(acc));
+        if (state->bufferedSize >= XXH3_STRIPE_LEN) {
+            size_t stripes = (state->bufferedSize - 1) / XXH3_STRIPE_LEN;
+            consumeStripes(acc, &stripesSoFar, state->buffer, stripes);
+            lastStripePtr = state->buffer + state->bufferedSize - XXH3_STRIPE_LEN;
+        } else {
+            size_t catchup = XXH3_STRIPE_LEN - state->bufferedSize;
+            memcpy(lastStripe, state->buffer + XXH3_BUFFER_SIZE - catchup, catchup);
+            memcpy(lastStripe + catchup, state->buffer, state->bufferedSize);
+            lastStripePtr = lastStripe;
+        }
+        accumulate(acc, lastStripePtr, kSecret + SECRET_LIMIT - SECRET_LASTACC_START, 1);
+        h.low = mergeAccs(acc, kSecret + SECRET_MERGEACCS_START, state->totalLen * PRIME64_1);
+        h.high = mergeAccs(acc, kSecret + SECRET_SIZE - sizeof(acc) - SECRET_MERGEACCS_START, ~(state->totalLen * PRIME64_2));
+    } else {
+        // the whole input is still in the buffer
+        h = hashShort(state->buffer, state->totalLen);
+    }
+    // canonical form, high half first and big endian, the rest of the digest is zero
+    unsigned char *bytes = (unsigned char *)digest->words;
+    memset(digest, 0, sizeof(sha2Digest));
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (unsigned char)(h.high >> (56 - 8 * i));
+        bytes[8 + i] = (unsigned char)(h.low >> (56 - 8 * i));
+    }
+}
+
+static void xxh128OpsInit(void *ctx) {
+    xxh128Reset(ctx);
+}
+
+static void xxh128OpsUpdate(void *ctx, const unsigned char *buf, size_t len) {
+    xxh128Update(ctx, buf, len);
+}
+
+static void xxh128OpsFinish(void *ctx, sha2Digest *digest) {
+    xxh128Digest(ctx, digest);
+}
+
+const digestOps xxh128Ops = {"xxh128", 16, sizeof(xxh128State), xxh128OpsInit, xxh128OpsUpdate, xxh128OpsFinish};